@@ -22,8 +22,33 @@
 ********************************************************************************************/
 #include "gframework.c"
 #include "raylib.h"
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+
+//------------------------------------------------------------------------------------
+// memory subsystems
+//------------------------------------------------------------------------------------
+#define PARTICLE_MEMORY 0
+#define STATION_MEMORY 1
+#define ASTEROID_MEMORY 2
+#define ROCKET_MEMORY 3
+#define EVENT_MEMORY 4
+#define TIMER_MEMORY 5
+#define SNAPSHOT_MEMORY 6
+
+void nameMemorySubsystems(){
+    setMemorySubsystemName(PARTICLE_MEMORY, "particles");
+    setMemorySubsystemName(STATION_MEMORY, "station");
+    setMemorySubsystemName(ASTEROID_MEMORY, "asteroids");
+    setMemorySubsystemName(ROCKET_MEMORY, "rockets");
+    setMemorySubsystemName(EVENT_MEMORY, "events");
+    setMemorySubsystemName(TIMER_MEMORY, "timers");
+    setMemorySubsystemName(SNAPSHOT_MEMORY, "snapshots");
+}
 
 //------------------------------------------------------------------------------------
 // asteroid predec
@@ -31,6 +56,7 @@
 #define ASTEROID_SMALL 0
 #define ASTEROID_MEDIUM 1
 #define ASTEROID_LARGE 2
+#define ASTEROID_SPRITE_START 14
 
 struct Asteroid{
     float x;
@@ -38,17 +64,50 @@ struct Asteroid{
     float direction;
     float speed;
     int size;
-    int lifeTime;
+    int spawnedAt;
+    int expiresAt;
     bool exists;
+    SpriteQuad quad; // direction never changes, so the rotated sprite is worked out once
 
 };
 typedef struct Asteroid Asteroid;
+// small asteroids can't be shot and only move in a straight line, so until they get close to the station
+// they are kept as swarms: the children of one asteroid share where and when they started and their speed,
+// positions are worked out from that when needed. every member has a single timer for whatever happens to
+// it next, turning into a regular asteroid near the station, despawning off screen or expiring
+#define MAX_SWARM_MEMBERS 3
+#define SWARM_MATERIALIZE 0
+#define SWARM_DESPAWN 1
+#define SWARM_EXPIRE 2
+struct Swarm{
+    float x;
+    float y;
+    float speed;
+    int bornAt; // lifetimes and despawning count from here
+    int originTick; // tick the members were at x, y, positions count from here
+    float direction[MAX_SWARM_MEMBERS];
+    // sin and cos of direction, worked out once for the position and the sprite. kept at double
+    // precision so positions come out the same as working them out every time
+    double directionX[MAX_SWARM_MEMBERS];
+    double directionY[MAX_SWARM_MEMBERS];
+    int eventAt[MAX_SWARM_MEMBERS];
+    unsigned char eventKind[MAX_SWARM_MEMBERS];
+    unsigned char members; // bitset of members still in the swarm
+};
+typedef struct Swarm Swarm;
+
+// default capacity, synthetic scenarios go way past it
 #define MAX_ASTEROIDS 300
 struct AsteroidCollection{
-    Asteroid asteroids[MAX_ASTEROIDS];
+    Asteroid* asteroids;
+    int capacity;
     int nextAsteroidIndex;
     int targetX;
     int targetY;
+    Swarm* swarms; // same capacity as the asteroids
+    int nextSwarmIndex;
+    int swarmMembers;
+    Rectangle swarmZone; // members inside of it become regular asteroids
 };
 typedef struct AsteroidCollection AsteroidCollection;
 
@@ -60,7 +119,10 @@ struct Rocket{
     float direction;
     float speed;
     bool exists;
-    int lifeTime;
+    int expiresAt;
+    SpriteQuad quad;
+    float lastDx; // how far it moved in its last update, asteroids sweep against that
+    float lastDy;
 };
 typedef struct Rocket Rocket;
 
@@ -80,6 +142,7 @@ struct GameState{
     int wave;
     int difficulity;
     int rubberBandDifficulityModifier;
+    int tickStep; // how many ticks a single update simulates
 };
 typedef struct GameState GameState;
 
@@ -94,19 +157,31 @@ GameState initGameState(){
     out.difficulity = 1;
     out.wave = 0;
     out.rubberBandDifficulityModifier = 0;
-
+    out.tickStep = 1;
 
     return out;
 }
 
+// collisions are swept, so larger steps don't tunnel, but nothing should move more than a tile per step
+#define MAX_TICK_STEP 8
+
+void setTickStep(GameState* state, int step){
+    state->tickStep = fmax(1, fmin(step, MAX_TICK_STEP));
+}
+
+// how many times "timer % period == 0" happened during the last step
+int countPeriodsCrossed(GameState* state, int period){
+    return state->gameTimer / period - (state->gameTimer - state->tickStep) / period;
+}
+
 void updateGameState(GameState* state, AsteroidCollection* collection){
 
-    state->gameTimer++;
+    state->gameTimer += state->tickStep;
 
 
     if (state->state == STATE_ATTACK){
 
-        state->waveTimer--;
+        state->waveTimer -= state->tickStep;
 
         if (state->waveTimer <= 0 && areAsteroidsAlive(collection) == false){
 
@@ -130,6 +205,60 @@ void activateWave(GameState* state){
 
 
 
+//------------------------------------------------------------------------------------
+// input
+//------------------------------------------------------------------------------------
+// the game only reads keys through here, so replays and tools can feed it input
+#define INPUT_UP 0
+#define INPUT_DOWN 1
+#define INPUT_LEFT 2
+#define INPUT_RIGHT 3
+#define INPUT_BUILD_WALL 4
+#define INPUT_BUILD_GENERATOR 5
+#define INPUT_BUILD_TURRET 6
+#define INPUT_BUILD_FORGE 7
+#define INPUT_START_WAVE 8
+#define INPUT_RESTART 9
+#define INPUT_COUNT 10
+const int INPUT_KEY_LOOKUP[] = {KEY_W, KEY_S, KEY_A, KEY_D, KEY_ONE, KEY_ONE + 1, KEY_ONE + 2, KEY_ONE + 3, KEY_SPACE, KEY_R};
+
+// one bit per input, set on the tick the key was pressed
+typedef unsigned short GameInput;
+GameInput gameInput = 0;
+
+GameInput pollGameInput(){
+    GameInput out = 0;
+    for (int i = 0; i < INPUT_COUNT; i++){
+        if (IsKeyPressed(INPUT_KEY_LOOKUP[i])){
+            out |= 1 << i;
+        }
+    }
+    return out;
+}
+
+bool isInputPressed(int input){
+    return (gameInput >> input) & 1;
+}
+
+//------------------------------------------------------------------------------------
+// timers
+//------------------------------------------------------------------------------------
+// lifetimes and cooldowns are absolute ticks scheduled on gameTimers, nothing counts them down,
+// an event only fires once one runs out. state->gameTimer is the only clock, everything is
+// scheduled from it and fireGameTimers brings the wheel up to it
+#define TIMER_TURRET_READY 0
+#define TIMER_ASTEROID_EXPIRE 1
+#define TIMER_ROCKET_EXPIRE 2
+#define TIMER_PARTICLE_EXPIRE 3
+#define TIMER_SWARM_MEMBER 4
+#define INITIAL_TIMER_CAPACITY 512
+TimerWheel gameTimers = {0};
+
+void initGameTimers(){
+    disposeTimerWheel(&gameTimers);
+    gameTimers = initTimerWheel(INITIAL_TIMER_CAPACITY, 0, TIMER_MEMORY);
+}
+
 //------------------------------------------------------------------------------------
 // particles
 //------------------------------------------------------------------------------------
@@ -140,7 +269,7 @@ struct Particle{
     int y;
     int type;
     bool destroy;
-    int lifeTime;
+    int expiresAt;
     struct Particle* next;
 };
 typedef struct Particle Particle;
@@ -153,8 +282,43 @@ void pushParticle(Particle* element, Particle** particles){
 
 }
 
-void initParticle(int x, int y, int type, Particle** particles){
-    Particle* p = malloc(sizeof(Particle));
+// particles are handed out from a free list that gets refilled a block at a time, so a burst of
+// spawns costs one allocation. blocks are only given back when the game is disposed
+#define PARTICLE_BLOCK_SIZE 64
+struct ParticleBlock{
+    struct ParticleBlock* next;
+    Particle particles[];
+};
+typedef struct ParticleBlock ParticleBlock;
+ParticleBlock* particleBlocks = 0;
+Particle* freeParticleList = 0;
+int freeParticleCount = 0;
+
+// makes sure the next count spawns don't allocate
+void reserveParticles(int count){
+    if (freeParticleCount >= count){
+        return;
+    }
+    int size = max(count - freeParticleCount, PARTICLE_BLOCK_SIZE);
+    ParticleBlock* block = fAlloc(PARTICLE_MEMORY, sizeof(ParticleBlock) + sizeof(Particle) * size);
+    block->next = particleBlocks;
+    particleBlocks = block;
+    for (int i = 0; i < size; i++){
+        pushParticle(&block->particles[i], &freeParticleList);
+    }
+    freeParticleCount += size;
+}
+
+void releaseParticle(Particle* p){
+    pushParticle(p, &freeParticleList);
+    freeParticleCount++;
+}
+
+void initParticle(int x, int y, int type, GameState* state, Particle** particles){
+    reserveParticles(1);
+    Particle* p = freeParticleList;
+    freeParticleList = p->next;
+    freeParticleCount--;
     p->x = x;
     p->y = y;
     p->destroy = false;
@@ -162,15 +326,27 @@ void initParticle(int x, int y, int type, Particle** particles){
     p->next = 0;
 
     switch (type){
-        case PARTICLE_POW: p->lifeTime = 20; break;
-        case PARTICLE_SCRAP: p->lifeTime = 45; break;
+        case PARTICLE_POW: p->expiresAt = state->gameTimer + 20; break;
+        case PARTICLE_SCRAP: p->expiresAt = state->gameTimer + 45; break;
 
     }
+    scheduleTimer(&gameTimers, p->expiresAt, TIMER_PARTICLE_EXPIRE, 0, p);
 
     pushParticle(p, particles);
 }
 
-void updateParticles(Particle** particles){
+void freeParticles(Particle** particles){
+    *particles = 0;
+    while (particleBlocks != 0){
+        ParticleBlock* temp = particleBlocks;
+        particleBlocks = temp->next;
+        fFree(temp);
+    }
+    freeParticleList = 0;
+    freeParticleCount = 0;
+}
+
+void updateParticles(Particle** particles, GameState* state){
     Particle* iter = *particles;
     Particle* prev = 0;
 
@@ -178,25 +354,20 @@ void updateParticles(Particle** particles){
     while (iter != 0){
 
         // draw
-        switch (iter->type){
-            case PARTICLE_POW:
+        if (!iter->destroy){
+            switch (iter->type){
+                case PARTICLE_POW:
 
-                draw(((iter->lifeTime / 45.0f) * 3.0f) + 11, iter->x, iter->y);
-                break;
-            case PARTICLE_SCRAP:
-                draw(9, iter->x, iter->y);
-                break;
-
-        }
+                    drawLowPriority((((iter->expiresAt - state->gameTimer) / 45.0f) * 3.0f) + 11, iter->x, iter->y);
+                    break;
+                case PARTICLE_SCRAP:
+                    drawLowPriority(9, iter->x, iter->y);
+                    break;
 
-
-        // destroy
-        iter->lifeTime--;
-        if (iter->lifeTime <= 0){
-            iter->destroy = true;
+            }
         }
 
-        // controll
+        // controll, destroy gets set when the particle's timer runs out
         if (iter->destroy){
             if (prev == 0){
                 *particles = iter->next;
@@ -205,7 +376,7 @@ void updateParticles(Particle** particles){
             }
             Particle* temp = iter;
             iter = iter->next;
-            free(temp);
+            releaseParticle(temp);
 
 
         }else {
@@ -222,52 +393,73 @@ void updateParticles(Particle** particles){
 //------------------------------------------------------------------------------------
 // rockets
 //------------------------------------------------------------------------------------
+// default capacity
 #define MAX_ROCKETS 30
-Rocket rockets[MAX_ROCKETS];
+Rocket* rockets = 0;
+int rocketCapacity = 0;
 int nextRocketIndex = 0;
 
-void initRocket(float x, float y, float rotation){
+void initRocket(float x, float y, float rotation, GameState* state){
     Rocket r;
     r.x = x;
     r.y = y;
     r.direction = rotation;
     r.speed = 4.5f;
     r.exists = true;
-    r.lifeTime = 200;
+    r.expiresAt = state->gameTimer + 200;
+    r.quad = initSpriteQuad(-rotation * RAD2DEG + 90);
+    r.lastDx = 0.0f;
+    r.lastDy = 0.0f;
 
-    int failsafe = MAX_ROCKETS;
+    int failsafe = rocketCapacity;
     while(rockets[nextRocketIndex].exists && failsafe-- > 0){
         nextRocketIndex++;
-        nextRocketIndex %= MAX_ROCKETS;
+        nextRocketIndex %= rocketCapacity;
     }
     rockets[nextRocketIndex] = r;
+    scheduleTimer(&gameTimers, r.expiresAt, TIMER_ROCKET_EXPIRE, nextRocketIndex, 0);
+}
+
+void disposeRockets(){
+    fFree(rockets);
+    rockets = 0;
+    rocketCapacity = 0;
 }
 
-void initRockets(){
-    for (int i = 0; i < MAX_ROCKETS; i++){
+void initRockets(int capacity){
+    if (capacity != rocketCapacity){
+        disposeRockets();
+        rockets = fAlloc(ROCKET_MEMORY, sizeof(Rocket) * capacity);
+        rocketCapacity = capacity;
+    }
+    nextRocketIndex = 0;
+
+    for (int i = 0; i < rocketCapacity; i++){
         rockets[i].exists = false;
     }
 }
 
 void updateRockets(Particle** particles, GameState* state){
-    for (int i = 0; i < MAX_ROCKETS; i++){
+    for (int i = 0; i < rocketCapacity; i++){
 
         Rocket* r = &rockets[i];
 
 
         if (r->exists){
-            r->x += sin(r->direction) * r->speed;
-            r->y += cos(r->direction) * r->speed;
-
-            drawR(10, r->x, r->y, -r->direction * RAD2DEG + 90);
-            r->lifeTime--;
-
-            if (r->lifeTime <= 0){
-                r->exists = false;
-
-            }
-            if (state->gameTimer % 4 == 0){
-                initParticle(r->x, r->y, PARTICLE_POW, particles);
+            float dx = sin(r->direction) * r->speed * state->tickStep;
+            float dy = cos(r->direction) * r->speed * state->tickStep;
+            r->x += dx;
+            r->y += dy;
+            r->lastDx = dx;
+            r->lastDy = dy;
+
+            drawQuad(10, r->x, r->y, &r->quad);
+
+            // one trail particle every 4 ticks, spread along the path when a step covers several
+            int trail = countPeriodsCrossed(state, 4);
+            for (int j = 0; j < trail; j++){
+                float back = (float)j / state->tickStep;
+                initParticle(r->x - dx * back, r->y - dy * back, PARTICLE_POW, state, particles);
             }
         }
     }
@@ -283,7 +475,7 @@ int scrapCount = 0;
 
 void addScrap(int x, int y, int ammount, GameState* gameState, Particle** particles){
     gameState->scrapCount += ammount;
-    initParticle(x, y, PARTICLE_SCRAP, particles);
+    initParticle(x, y, PARTICLE_SCRAP, gameState, particles);
 }
 
 
@@ -292,19 +484,24 @@ void addScrap(int x, int y, int ammount, GameState* gameState, Particle** partic
 //------------------------------------------------------------------------------------
 // tile
 //------------------------------------------------------------------------------------
+// tiles are split by how often they are read. the hot part is what every station scan
+// (lookups, collisions, turrets) needs and is packed into a few bytes: grid position and type
+// here, world position as separate x and y arrays on the station so collisions can test
+// them in batches, exists and isPowered as bitsets. health and cooldowns are only touched
+// when something happens to a tile, so they live in a separate array
 struct StationTile{
+    short stationX;
+    short stationY;
+    unsigned char type;
+};
+typedef struct StationTile StationTile;
+
+struct StationTileCold{
     int health;
     int maxHealth;
-    int type;
-    bool isPowered;
-    int x;
-    int y;
-    int stationX;
-    int stationY;
-    bool exists;
-    int cooldown;
+    int readyAt; // tick the turret can shoot again
 };
-typedef struct StationTile StationTile;
+typedef struct StationTileCold StationTileCold;
 
 #define STATION_WALL 0
 #define STATION_GENERATOR 1
@@ -312,132 +509,152 @@ typedef struct StationTile StationTile;
 #define STATION_FORGE 3
 #define STATION_CORE 4
 #define STATION_SPRITE_START 1
+#define TURRET_COOLDOWN 100
 int STATION_TILE_HEALTH_LOOKUP[] = {50, 20, 40, 30, 100};
 int STATION_TILE_COST_LOOKUP[] = {20, 30, 40, 40};
 
+bool isTileTypeGenerator(int type){
+    switch (type){
+        case STATION_GENERATOR:
+        case STATION_CORE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+//------------------------------------------------------------------------------------
+// Station
+//------------------------------------------------------------------------------------
+// default capacity, synthetic scenarios go way past it
+#define MAX_STATION_TILES 120
+struct Station{
+    StationTile* tiles;
+    short* tileX; // world position
+    short* tileY;
+    StationTileCold* tileCold;
+    unsigned int* tileExists; // bitsets, one bit per tile
+    unsigned int* tilePowered;
+    int tileCapacity;
+    int* readyTurrets; // tile indices of turrets that are off cooldown
+    unsigned int* turretListed; // bitset of the tiles in readyTurrets, so none is listed twice
+    int readyTurretCount;
+    int nextTileIndex;
+    int cursorX;
+    int cursorY;
+    int x;
+    int y;
+    Rectangle bounds; // world space box around every tile ever placed
+};
+typedef struct Station Station;
+
+bool tileExists(Station* station, int index){
+    return testBit(station->tileExists, index);
+}
+
+bool isTilePowered(Station* station, int index){
+    return testBit(station->tilePowered, index);
+}
+
+// walks existing tiles, for (int i = nextTile(station, 0); i >= 0; i = nextTile(station, i + 1))
+int nextTile(Station* station, int from){
+    return nextSetBit(station->tileExists, from, station->tileCapacity);
+}
 
-void drawStationTile(StationTile* tile, GameState* state){
-    draw(STATION_SPRITE_START + tile->type, tile->x, tile->y);
+void drawStationTile(Station* station, int index, GameState* state){
+    StationTileCold* cold = &station->tileCold[index];
+    int x = station->tileX[index];
+    int y = station->tileY[index];
+    draw(STATION_SPRITE_START + station->tiles[index].type, x, y);
 
 
     // draw damage
-    if (tile->health < tile->maxHealth >> 1){
-        draw(7, tile->x, tile->y);
-    }else if(tile->health < tile->maxHealth){
-        draw(6, tile->x, tile->y);
+    if (cold->health < cold->maxHealth >> 1){
+        draw(7, x, y);
+    }else if(cold->health < cold->maxHealth){
+        draw(6, x, y);
     }
 
     // unpowered status
-    if (tile->isPowered == false){
+    if (!isTilePowered(station, index)){
         Color c = WHITE;
         c.a = (unsigned char)lerp(40, WHITE.r, (sin(state->gameTimer / 25.0f) * 0.5f + 0.5f));
 
-        drawC(17, tile->x, tile->y, c);
+        drawC(17, x, y, c);
     }
 
 
 }
 
-void roundEndTileUpdate(StationTile* tile, GameState* gameState, Particle** particles){
+void roundEndTileUpdate(Station* station, int index, GameState* gameState, Particle** particles){
+    int x = station->tileX[index];
+    int y = station->tileY[index];
+
     // repair rile
-    tile->health = tile->maxHealth;
+    station->tileCold[index].health = station->tileCold[index].maxHealth;
 
-    if (!tile->isPowered){
+    if (!isTilePowered(station, index)){
         return;
     }
 
-    switch (tile->type){
+    switch (station->tiles[index].type){
         case STATION_FORGE:
-            addScrap(tile->x, tile->y, 20, gameState, particles);
+            addScrap(x, y, 20, gameState, particles);
             break;
         case STATION_CORE:
-            addScrap(tile->x, tile->y, 60, gameState, particles);
+            addScrap(x, y, 60, gameState, particles);
     }
 }
 
-void setTilePoweredStatus(StationTile* tile, bool isNextToGenerator){
-    switch (tile->type){
+void setTilePoweredStatus(Station* station, int index, bool isNextToGenerator){
+    switch (station->tiles[index].type){
         case STATION_FORGE:
         case STATION_TURRET:
-            tile->isPowered = isNextToGenerator;
+            setBit(station->tilePowered, index, isNextToGenerator);
             break;
         default:
-            tile->isPowered = true;
+            setBit(station->tilePowered, index, true);
             break;
     }
 }
 
-bool isTileTypeGenerator(int type){
-    switch (type){
-        case STATION_GENERATOR:
-        case STATION_CORE:
-            return true;
-        default:
-            return false;
-    }
-}
-
-StationTile initStationTile(int type, int x, int y, int stationX, int stationY){
-    StationTile out;
-    out.x = x;
-    out.y = y;
-    out.stationX = stationX;
-    out.stationY = stationY;
-    out.isPowered = true;
-    out.maxHealth = STATION_TILE_HEALTH_LOOKUP[type];
-    out.health = out.maxHealth;
-    out.type = type;
-    out.exists = true;
-    out.cooldown = 0;
-
-    return out;
-}
-
-StationTile initEmptyTile(){
-    StationTile out;
-    out.x = 0;
-    out.y = 0;
-    out.stationX = 0;
-    out.stationY = 0;
-    out.isPowered = true;
-    out.maxHealth = 0;
-    out.health = 0;
-    out.type = 0;
-    out.exists = false;
-    out.cooldown = 0;
-
-
-    return out;
-
+void setStationTile(Station* station, int index, int type, int x, int y, int stationX, int stationY){
+    station->tileX[index] = x;
+    station->tileY[index] = y;
+
+    float right = fmax(station->bounds.x + station->bounds.width, x + 32);
+    float bottom = fmax(station->bounds.y + station->bounds.height, y + 32);
+    station->bounds.x = fmin(station->bounds.x, x);
+    station->bounds.y = fmin(station->bounds.y, y);
+    station->bounds.width = right - station->bounds.x;
+    station->bounds.height = bottom - station->bounds.y;
+
+    StationTile* tile = &station->tiles[index];
+    tile->stationX = stationX;
+    tile->stationY = stationY;
+    tile->type = type;
+
+    StationTileCold* cold = &station->tileCold[index];
+    cold->maxHealth = STATION_TILE_HEALTH_LOOKUP[type];
+    cold->health = cold->maxHealth;
+    cold->readyAt = 0;
+
+    setBit(station->tileExists, index, true);
+    setBit(station->tilePowered, index, true);
 }
 
-void damageTile(StationTile* tile, int damage){
-    tile->health -= damage;
-    if (tile->health < 0){
-        tile->exists = false;
-        tile->stationX = -999;
-        tile->stationY = -999;
+void damageTile(Station* station, int index, int damage){
+    StationTileCold* cold = &station->tileCold[index];
+    cold->health -= damage;
+    if (cold->health < 0){
+        setBit(station->tileExists, index, false);
     }
 }
 
-//------------------------------------------------------------------------------------
-// Station
-//------------------------------------------------------------------------------------
-#define MAX_STATION_TILES 120
-struct Station{
-    StationTile tiles[MAX_STATION_TILES];
-    int nextTileIndex;
-    int cursorX;
-    int cursorY;
-    int x;
-    int y;
-};
-typedef struct Station Station;
-
 bool canCursorMoveTo(Station* station, int newX, int newY){
-    for (int i = 0; i < MAX_STATION_TILES; i++){
+    for (int i = nextTile(station, 0); i >= 0; i = nextTile(station, i + 1)){
         StationTile* tile = &station->tiles[i];
-        if (tile->exists && abs(tile->stationX - newX) <= 1 && abs(tile->stationY - newY) <= 1){
+        if (abs(tile->stationX - newX) <= 1 && abs(tile->stationY - newY) <= 1){
             return true;
         }
     }
@@ -445,44 +662,36 @@ bool canCursorMoveTo(Station* station, int newX, int newY){
 }
 
 
-StationTile* getTile(Station* station, int tileX, int tileY){
+// index of the existing tile at tileX, tileY, -1 if there is none
+int getTile(Station* station, int tileX, int tileY){
 
-    for (int i = 0; i < MAX_STATION_TILES; i++){
+    for (int i = nextTile(station, 0); i >= 0; i = nextTile(station, i + 1)){
 
         StationTile* tile = &station->tiles[i];
 
         if (tile->stationX == tileX && tile->stationY == tileY){
-            return tile;
+            return i;
         }
     }
-    return 0;
+    return -1;
 }
 
 
 bool canBuildTile(Station* station){
-    StationTile* tile = getTile(station, station->cursorX, station->cursorY);
-
-    if (tile == 0 || tile->exists == false){
-        return true;
-    }
-    return false;
+    return getTile(station, station->cursorX, station->cursorY) < 0;
 }
 
 void updateStationPoweredStatus(Station* station){
-    for (int i = 0; i < MAX_STATION_TILES; i++){
+    for (int i = nextTile(station, 0); i >= 0; i = nextTile(station, i + 1)){
 
         StationTile* tile = &station->tiles[i];
 
-        if (!tile->exists){
-            continue;
-        }
-
         bool isNextToGenerator = false;
         for (int x = tile->stationX - 1; x <= tile->stationX + 1; x++){
             for (int y = tile->stationY - 1; y <= tile->stationY + 1; y++){
-                StationTile* tile = getTile(station, x, y);
+                int neighbour = getTile(station, x, y);
 
-                if (tile != 0 && tile->exists && isTileTypeGenerator(tile->type)){
+                if (neighbour >= 0 && isTileTypeGenerator(station->tiles[neighbour].type)){
                     isNextToGenerator = true;
                     goto exitLoop;
                 }
@@ -490,36 +699,75 @@ void updateStationPoweredStatus(Station* station){
         }
         exitLoop:
 
-        setTilePoweredStatus(tile, isNextToGenerator);
+        setTilePoweredStatus(station, i, isNextToGenerator);
     }
 }
 
 
-void addTile(Station* station, int type, int x, int y){
+// entries can go stale when a turret is destroyed, they are only dropped by the attack loop. a slot
+// that gets a turret again while still listed keeps its old entry instead of getting a second one
+void listReadyTurret(Station* station, int index){
+    if (testBit(station->turretListed, index)){
+        return;
+    }
+    assert(station->readyTurretCount < station->tileCapacity);
+    setBit(station->turretListed, index, true);
+    station->readyTurrets[station->readyTurretCount++] = index;
+}
 
-    StationTile tile = initStationTile(type, station->x + (x * 32), station->y + (y * 32), x, y);
+// swaps the last entry into position i
+void unlistReadyTurret(Station* station, int i){
+    setBit(station->turretListed, station->readyTurrets[i], false);
+    station->readyTurrets[i] = station->readyTurrets[--station->readyTurretCount];
+}
+
+// adds a tile without updating power, for building many tiles at once
+void placeTile(Station* station, int type, int x, int y){
 
-    int failsafe = MAX_STATION_TILES;
-    while(station->tiles[station->nextTileIndex].exists == true && failsafe-- > 0){
+    int failsafe = station->tileCapacity;
+    while(tileExists(station, station->nextTileIndex) && failsafe-- > 0){
         station->nextTileIndex++;
-        station->nextTileIndex %= MAX_STATION_TILES;
+        station->nextTileIndex %= station->tileCapacity;
+    }
+    setStationTile(station, station->nextTileIndex, type, station->x + (x * 32), station->y + (y * 32), x, y);
+
+    if (type == STATION_TURRET){
+        listReadyTurret(station, station->nextTileIndex);
     }
-    station->tiles[station->nextTileIndex] = tile;
+}
+
+void addTile(Station* station, int type, int x, int y){
+    placeTile(station, type, x, y);
     updateStationPoweredStatus(station);
 }
 
-Station initStation(int x, int y){
+Station initStation(int x, int y, int capacity){
     Station out;
+    out.tiles = fAlloc(STATION_MEMORY, sizeof(StationTile) * capacity);
+    out.tileX = fAlloc(STATION_MEMORY, sizeof(short) * capacity);
+    out.tileY = fAlloc(STATION_MEMORY, sizeof(short) * capacity);
+    out.tileCold = fAlloc(STATION_MEMORY, sizeof(StationTileCold) * capacity);
+    out.tileExists = fAlloc(STATION_MEMORY, sizeof(unsigned int) * bitsetWords(capacity));
+    out.tilePowered = fAlloc(STATION_MEMORY, sizeof(unsigned int) * bitsetWords(capacity));
+    out.tileCapacity = capacity;
+    out.readyTurrets = fAlloc(STATION_MEMORY, sizeof(int) * capacity);
+    out.turretListed = fAlloc(STATION_MEMORY, sizeof(unsigned int) * bitsetWords(capacity));
+    out.readyTurretCount = 0;
     out.nextTileIndex = 0;
     out.cursorX = 0;
     out.cursorY = 0;
     out.x = x;
     out.y = y;
+    out.bounds = (Rectangle){x, y, 32, 32};
 
     // init empty tiles
-    for (int i = 0; i < MAX_STATION_TILES; i++){
-        out.tiles[i] = initEmptyTile();
-    }
+    memset(out.tiles, 0, sizeof(StationTile) * capacity);
+    memset(out.tileX, 0, sizeof(short) * capacity);
+    memset(out.tileY, 0, sizeof(short) * capacity);
+    memset(out.tileCold, 0, sizeof(StationTileCold) * capacity);
+    memset(out.tileExists, 0, sizeof(unsigned int) * bitsetWords(capacity));
+    memset(out.tilePowered, 0, sizeof(unsigned int) * bitsetWords(capacity));
+    memset(out.turretListed, 0, sizeof(unsigned int) * bitsetWords(capacity));
 
 
     addTile(&out, STATION_CORE, 0, 0);
@@ -530,17 +778,48 @@ Station initStation(int x, int y){
     return out;
 }
 
-StationTile* collidesWithStation(Station* station, int x, int y, int w, int h){
-    for (int i = 0; i < MAX_STATION_TILES; i++){
-
-        StationTile* tile = &station->tiles[i];
+void disposeStation(Station* station){
+    fFree(station->tiles);
+    fFree(station->tileX);
+    fFree(station->tileY);
+    fFree(station->tileCold);
+    fFree(station->tileExists);
+    fFree(station->tilePowered);
+    fFree(station->readyTurrets);
+    fFree(station->turretListed);
+    station->tiles = 0;
+    station->tileX = 0;
+    station->tileY = 0;
+    station->tileCold = 0;
+    station->tileExists = 0;
+    station->tilePowered = 0;
+    station->readyTurrets = 0;
+    station->turretListed = 0;
+    station->readyTurretCount = 0;
+    station->tileCapacity = 0;
+}
 
-        if (tile->exists && checkBoxCollisions(x, y, w, h, tile->x, tile->y, 32, 32)){
-            return tile;
+// returns the index of the tile a box moving by dx, dy hits first, -1 if it hits none
+int sweptCollidesWithStation(Station* station, float x, float y, int w, int h, float dx, float dy){
+    // tiles overlapping the box covering the whole move are found in batches, only those get the exact swept test
+    int minX = floor(fmin(x, x + dx));
+    int minY = floor(fmin(y, y + dy));
+    int sweepW = ceil(fmax(x, x + dx)) - minX + w;
+    int sweepH = ceil(fmax(y, y + dy)) - minY + h;
+
+    int out = -1;
+    float firstContact = 2.0f;
+    for (int i = firstBoxBatchHit(minX, minY, sweepW, sweepH, station->tileX, station->tileY, 32, 32, station->tileCapacity, station->tileExists); i >= 0;
+        i = nextBoxBatchHit(minX, minY, sweepW, sweepH, station->tileX, station->tileY, 32, 32, station->tileCapacity, station->tileExists, i + 1)){
+
+        float t = sweptBoxContactTime(x, y, w, h, dx, dy, station->tileX[i], station->tileY[i], 32, 32);
+        if (t >= 0.0f && t < firstContact){
+            firstContact = t;
+            out = i;
         }
 
     }
-    return 0;
+    return out;
 }
 
 Asteroid* findClosestAsteroid(AsteroidCollection*, float x, float y);
@@ -549,10 +828,8 @@ void updateStation(Station* station, GameState* state, Particle** particles, Ast
 
 
     // draw tiles
-    for (int i = 0; i < MAX_STATION_TILES; i++){
-        if (station->tiles[i].exists){
-            drawStationTile(&station->tiles[i], state);
-        }
+    for (int i = nextTile(station, 0); i >= 0; i = nextTile(station, i + 1)){
+        drawStationTile(station, i, state);
     }
 
 
@@ -561,16 +838,11 @@ void updateStation(Station* station, GameState* state, Particle** particles, Ast
         if (state->giveReward){
             state->giveReward = false;
 
-            for (int i = 0; i < MAX_STATION_TILES; i++){
-
-                StationTile* tile = &station->tiles[i];
-
-                if (tile->exists){
+            for (int i = nextTile(station, 0); i >= 0; i = nextTile(station, i + 1)){
 
 
-                    roundEndTileUpdate(tile, state, particles);
+                roundEndTileUpdate(station, i, state, particles);
 
-                }
 
             }
             // assign rubberBandDifficulityModifier
@@ -586,8 +858,7 @@ void updateStation(Station* station, GameState* state, Particle** particles, Ast
             }
 
             // check game over
-            StationTile* coreTile = getTile(station, 0, 0);
-            if (coreTile == 0 || coreTile->exists == false){
+            if (getTile(station, 0, 0) < 0){
                 state->state = STATE_GAME_OVER;
             }
         }
@@ -596,26 +867,26 @@ void updateStation(Station* station, GameState* state, Particle** particles, Ast
         // cursor
         draw(18, station->x + (station->cursorX * 32), station->y + (station->cursorY * 32));
 
-        if (IsKeyPressed(KEY_W) && canCursorMoveTo(station, station->cursorX, station->cursorY - 1)){
+        if (isInputPressed(INPUT_UP) && canCursorMoveTo(station, station->cursorX, station->cursorY - 1)){
             station->cursorY -= 1;
         }
 
-        if (IsKeyPressed(KEY_S) && canCursorMoveTo(station, station->cursorX, station->cursorY + 1)){
+        if (isInputPressed(INPUT_DOWN) && canCursorMoveTo(station, station->cursorX, station->cursorY + 1)){
             station->cursorY += 1;
         }
 
-        if (IsKeyPressed(KEY_A) && canCursorMoveTo(station, station->cursorX - 1, station->cursorY)){
+        if (isInputPressed(INPUT_LEFT) && canCursorMoveTo(station, station->cursorX - 1, station->cursorY)){
             station->cursorX -= 1;
         }
 
-        if (IsKeyPressed(KEY_D) && canCursorMoveTo(station, station->cursorX + 1, station->cursorY)){
+        if (isInputPressed(INPUT_RIGHT) && canCursorMoveTo(station, station->cursorX + 1, station->cursorY)){
             station->cursorX += 1;
         }
 
         // building
         if (canBuildTile(station)){
             for (int i = 0; i <= 3; i++){
-                if (IsKeyPressed(KEY_ONE + i) && state->scrapCount >= STATION_TILE_COST_LOOKUP[i]){
+                if (isInputPressed(INPUT_BUILD_WALL + i) && state->scrapCount >= STATION_TILE_COST_LOOKUP[i]){
                     addTile(station, i, station->cursorX, station->cursorY);
                     state->scrapCount -= STATION_TILE_COST_LOOKUP[i];
                 }
@@ -624,7 +895,7 @@ void updateStation(Station* station, GameState* state, Particle** particles, Ast
 
 
         // start wave
-        if (IsKeyPressed(KEY_SPACE)){
+        if (isInputPressed(INPUT_START_WAVE)){
             activateWave(state);
         }
     }
@@ -634,25 +905,32 @@ void updateStation(Station* station, GameState* state, Particle** particles, Ast
 
 
     else if (state->state == STATE_ATTACK){
-        // shoot
-        for (int i = 0; i < MAX_STATION_TILES; i++){
-            StationTile* tile = &station->tiles[i];
-            if (tile->exists && tile->isPowered && tile->type == STATION_TURRET){
-
-                tile->cooldown--;
-
-                if (tile->cooldown <= 0){
-                    Asteroid* a = findClosestAsteroid(asteroids, tile->x, tile->y);
-
-                    if (a != 0){
+        // shoot, only turrets that are off cooldown are looked at
+        for (int i = 0; i < station->readyTurretCount; i++){
+            int index = station->readyTurrets[i];
+            StationTile* tile = &station->tiles[index];
+            StationTileCold* cold = &station->tileCold[index];
+
+            // destroyed, replaced or listed twice
+            if (!tileExists(station, index) || tile->type != STATION_TURRET || cold->readyAt > state->gameTimer){
+                unlistReadyTurret(station, i--);
+                continue;
+            }
 
-                        initRocket(tile->x, tile->y, atan2(a->x - tile->x, a->y - tile->y));
-                        tile->cooldown = 100;
+            if (!isTilePowered(station, index)){
+                continue;
+            }
 
+            int x = station->tileX[index];
+            int y = station->tileY[index];
+            Asteroid* a = findClosestAsteroid(asteroids, x, y);
 
-                    }
+            if (a != 0){
 
-                }
+                initRocket(x, y, atan2(a->x - x, a->y - y), state);
+                cold->readyAt = state->gameTimer + TURRET_COOLDOWN;
+                scheduleTimer(&gameTimers, cold->readyAt, TIMER_TURRET_READY, index, 0);
+                unlistReadyTurret(station, i--);
 
             }
         }
@@ -667,7 +945,7 @@ Asteroid* findClosestAsteroid(AsteroidCollection* collection, float x, float y){
 
     Asteroid* out = 0;
     float dist = 200.0f;
-    for (int i = 0; i < MAX_ASTEROIDS; i++){
+    for (int i = 0; i < collection->capacity; i++){
         Asteroid* a = &collection->asteroids[i];
 
         if (a->exists && a->size > 0){
@@ -683,54 +961,96 @@ Asteroid* findClosestAsteroid(AsteroidCollection* collection, float x, float y){
 
 }
 
-#define SMALL_ASTEROID_LIFETIME 400
-void initAsteroid(AsteroidCollection* collection, float x, float y, int size, float direction, float speed){
-    if (size < 0){
-        return;
+void placeAsteroid(AsteroidCollection* collection, Asteroid a){
+    int failsafe = collection->capacity;
+    while(collection->asteroids[collection->nextAsteroidIndex].exists && failsafe-- > 0){
+        collection->nextAsteroidIndex++;
+        collection->nextAsteroidIndex %= collection->capacity;
     }
 
+    collection->asteroids[collection->nextAsteroidIndex] = a;
+    scheduleTimer(&gameTimers, a.expiresAt, TIMER_ASTEROID_EXPIRE, collection->nextAsteroidIndex, 0);
+}
+
+int beginSwarm(AsteroidCollection* collection, GameState* state, float x, float y, float speed, int originTick);
+void addSwarmMember(AsteroidCollection* collection, int swarmIndex, float direction);
+
+#define SMALL_ASTEROID_LIFETIME 400
+Asteroid makeAsteroid(GameState* state, float x, float y, int size, float direction, float speed){
     Asteroid a;
     a.x = x;
     a.y = y;
     a.size = size;
     a.direction = direction;
     a.speed = speed;
-    a.lifeTime = SMALL_ASTEROID_LIFETIME * (size + 1);
+    a.spawnedAt = state->gameTimer;
+    a.expiresAt = a.spawnedAt + SMALL_ASTEROID_LIFETIME * (size + 1);
     a.exists = true;
+    a.quad = initSpriteQuad(direction * RAD2DEG);
+    return a;
+}
 
-    int failsafe = MAX_ASTEROIDS;
-    while(collection->asteroids[collection->nextAsteroidIndex].exists && failsafe-- > 0){
-        collection->nextAsteroidIndex++;
-        collection->nextAsteroidIndex %= MAX_ASTEROIDS;
+// small ones end up in a swarm of their own. wave spawns happen before the update loop and move
+// on the tick they spawn, everything else first moves on the next update
+void initAsteroid(AsteroidCollection* collection, GameState* state, float x, float y, int size, float direction, float speed, bool movesThisTick){
+    if (size < 0){
+        return;
     }
-
-    collection->asteroids[collection->nextAsteroidIndex] = a;
+    if (size == ASTEROID_SMALL){
+        int originTick = state->gameTimer - (movesThisTick ? state->tickStep : 0);
+        addSwarmMember(collection, beginSwarm(collection, state, x, y, speed, originTick), direction);
+        return;
+    }
+    placeAsteroid(collection, makeAsteroid(state, x, y, size, direction, speed));
 }
 
-void destroyAsteroid(Asteroid* this, AsteroidCollection* collection, Particle** particles){
+void destroyAsteroid(Asteroid* this, AsteroidCollection* collection, GameState* state, Particle** particles){
     this->exists = false;
-    initParticle(this->x + (sin(this->direction) * 16), this->y + (cos(this->direction) * 16), PARTICLE_POW, particles);
+    initParticle(this->x + (sin(this->direction) * 16), this->y + (cos(this->direction) * 16), PARTICLE_POW, state, particles);
+    int swarm = this->size - 1 == ASTEROID_SMALL ? beginSwarm(collection, state, this->x, this->y, this->speed * 1.1f, state->gameTimer) : -1;
     for (int i = GetRandomValue(2, 3); i > 0; i--){
         float direction = GetRandomValue(0, 360) * DEG2RAD;
-        initAsteroid(collection, this->x, this->y, this->size - 1, direction, this->speed * 1.1f);
+        if (swarm >= 0){
+            addSwarmMember(collection, swarm, direction);
+        }else {
+            initAsteroid(collection, state, this->x, this->y, this->size - 1, direction, this->speed * 1.1f, false);
+        }
     }
 
 }
 
-AsteroidCollection initAsteroidCollection(int targetX, int targetY){
+AsteroidCollection initAsteroidCollection(int targetX, int targetY, int capacity){
     AsteroidCollection collection;
+    collection.asteroids = fAlloc(ASTEROID_MEMORY, sizeof(Asteroid) * capacity);
+    collection.capacity = capacity;
     collection.nextAsteroidIndex = 0;
     collection.targetX = targetX;
     collection.targetY = targetY;
+    collection.swarms = fAlloc(ASTEROID_MEMORY, sizeof(Swarm) * capacity);
+    collection.nextSwarmIndex = 0;
+    collection.swarmMembers = 0;
+    collection.swarmZone = (Rectangle){targetX, targetY, 32, 32};
 
-    for (int i = 0; i < MAX_ASTEROIDS; i++){
+    for (int i = 0; i < capacity; i++){
         collection.asteroids[i].exists = false;
+        collection.swarms[i].members = 0;
     }
     return collection;
 }
 
+void disposeAsteroidCollection(AsteroidCollection* collection){
+    fFree(collection->asteroids);
+    fFree(collection->swarms);
+    collection->asteroids = 0;
+    collection->swarms = 0;
+    collection->capacity = 0;
+}
+
 bool areAsteroidsAlive(AsteroidCollection* collection){
-    for (int i = 0; i < MAX_ASTEROIDS; i++){
+    if (collection->swarmMembers > 0){
+        return true;
+    }
+    for (int i = 0; i < collection->capacity; i++){
         if (collection->asteroids[i].exists){
             return true;
         }
@@ -738,93 +1058,1495 @@ bool areAsteroidsAlive(AsteroidCollection* collection){
     return false;
 }
 
-#define ASTEROID_SPRITE_START 14
-#define ASTEROID_SPAWN_DISTANCE 356
-void updateAsteroids(AsteroidCollection* collection, GameState* state, Station* station, Particle** particles){
-
-    // spawn asteroids
-    if (state->state == STATE_ATTACK){
-
-        if (state->gameTimer % 10 == 0 && state->waveTimer > 0){
-
-            for (int i = GetRandomValue(1, state->difficulity); i > 0;i--){
+//------------------------------------------------------------------------------------
+// swarms
+//------------------------------------------------------------------------------------
+// off screen asteroids older than this get despawned
+#define ASTEROID_DESPAWN_AGE 300
+// members become regular asteroids this far out from the station, before any of them can touch a tile
+#define SWARM_ZONE_MARGIN 32
+const Rectangle SCREEN_AREA = {0, 0, 640, 420};
+
+void setSwarmZone(AsteroidCollection* collection, Station* station){
+    Rectangle zone = station->bounds;
+    zone.x -= SWARM_ZONE_MARGIN;
+    zone.y -= SWARM_ZONE_MARGIN;
+    zone.width += SWARM_ZONE_MARGIN * 2;
+    zone.height += SWARM_ZONE_MARGIN * 2;
+    collection->swarmZone = zone;
+}
 
-                float direction = GetRandomValue(0, 360) * DEG2RAD;
+void getSwarmMemberPosition(Swarm* swarm, int member, int tick, float* x, float* y){
+    float distance = swarm->speed * (tick - swarm->originTick);
+    *x = swarm->x + swarm->directionX[member] * distance;
+    *y = swarm->y + swarm->directionY[member] * distance;
+}
 
+// ages (ticks since originTick) during which a member's box overlaps the area, with the
+// per tick movement as the sweep the swept overlap helpers give their times in ticks
+void getSwarmOverlapAges(Swarm* swarm, int member, Rectangle area, float* enter, float* exit){
+    float enterX, exitX, enterY, exitY;
+    sweptAxisOverlap(swarm->x, 32, swarm->directionX[member] * swarm->speed, area.x, area.width, &enterX, &exitX);
+    sweptAxisOverlap(swarm->y, 32, swarm->directionY[member] * swarm->speed, area.y, area.height, &enterY, &exitY);
+    *enter = fmax(enterX, enterY);
+    *exit = fmin(exitX, exitY);
+}
 
-                float spawnX = collection->targetX + (sin(direction + PI) * ASTEROID_SPAWN_DISTANCE);
-                float spawnY = collection->targetY + (cos(direction + PI) * ASTEROID_SPAWN_DISTANCE);
+Asteroid swarmMemberAsteroid(Swarm* swarm, int member, int tick){
+    Asteroid a;
+    getSwarmMemberPosition(swarm, member, tick, &a.x, &a.y);
+    a.size = ASTEROID_SMALL;
+    a.direction = swarm->direction[member];
+    a.speed = swarm->speed;
+    a.spawnedAt = swarm->bornAt;
+    a.expiresAt = swarm->bornAt + SMALL_ASTEROID_LIFETIME;
+    a.exists = true;
+    a.quad = initSpriteQuadSinCos(swarm->directionX[member], swarm->directionY[member]);
+    return a;
+}
 
-                float speed = 1.0f + (GetRandomValue(0, 4) * 0.2f);
-                int size = GetRandomValue(ASTEROID_SMALL, ASTEROID_LARGE);
+void removeSwarmMember(AsteroidCollection* collection, Swarm* swarm, int member){
+    swarm->members &= ~(1 << member);
+    collection->swarmMembers--;
+}
 
-                initAsteroid(collection, spawnX, spawnY, size, direction, speed);
-            }
-        }
+int beginSwarm(AsteroidCollection* collection, GameState* state, float x, float y, float speed, int originTick){
+    int failsafe = collection->capacity;
+    while(collection->swarms[collection->nextSwarmIndex].members != 0 && failsafe-- > 0){
+        collection->nextSwarmIndex++;
+        collection->nextSwarmIndex %= collection->capacity;
     }
-    // update asteroids
-    for (int i = 0; i < MAX_ASTEROIDS; i++){
-        Asteroid* asteroid = &collection->asteroids[i];
-
-
-        if (!asteroid->exists){
-            continue;
-        }
-
-        asteroid->lifeTime--;
 
-        // move
-        asteroid->x += sin(asteroid->direction) * asteroid->speed;
-        asteroid->y += cos(asteroid->direction) * asteroid->speed;
+    Swarm* swarm = &collection->swarms[collection->nextSwarmIndex];
+    collection->swarmMembers -= __builtin_popcount(swarm->members);
+    swarm->x = x;
+    swarm->y = y;
+    swarm->speed = speed;
+    swarm->bornAt = state->gameTimer;
+    swarm->originTick = originTick;
+    swarm->members = 0;
+    return collection->nextSwarmIndex;
+}
 
-        // draw
-        drawR(ASTEROID_SPRITE_START + asteroid->size, asteroid->x, asteroid->y, asteroid->direction * RAD2DEG);
+// works out what happens to the member first, the same rules regular asteroids go through in updateAsteroids
+void addSwarmMember(AsteroidCollection* collection, int swarmIndex, float direction){
+    Swarm* swarm = &collection->swarms[swarmIndex];
+    int member = 0;
+    while (member < MAX_SWARM_MEMBERS && (swarm->members >> member) & 1){
+        member++;
+    }
+    if (member == MAX_SWARM_MEMBERS){
+        return;
+    }
+    swarm->direction[member] = direction;
+    swarm->directionX[member] = sin(direction);
+    swarm->directionY[member] = cos(direction);
+
+    // ages count from originTick, wave spawns are already one step old when they are born
+    int bornAge = swarm->bornAt - swarm->originTick;
+    int eventAge = bornAge + SMALL_ASTEROID_LIFETIME;
+    int eventKind = SWARM_EXPIRE;
+
+    // despawns the first tick it is past the despawn age and off screen
+    float enter, exit;
+    getSwarmOverlapAges(swarm, member, SCREEN_AREA, &enter, &exit);
+    float despawnAge = bornAge + ASTEROID_DESPAWN_AGE + 1;
+    if (enter < despawnAge && despawnAge < exit){
+        despawnAge = ceil(exit);
+    }
+    if (despawnAge < eventAge){
+        eventAge = despawnAge;
+        eventKind = SWARM_DESPAWN;
+    }
 
+    getSwarmOverlapAges(swarm, member, collection->swarmZone, &enter, &exit);
+    if (enter < exit && exit > 0 && enter < eventAge){
+        eventAge = fmax(0, floor(enter));
+        eventKind = SWARM_MATERIALIZE;
+    }
 
-        if (asteroid->lifeTime == 0){
-            destroyAsteroid(asteroid, collection, particles);
-        }else if (asteroid->lifeTime < (SMALL_ASTEROID_LIFETIME * (asteroid->size + 1)) - 300
-            && !checkBoxCollisions(asteroid->x, asteroid->y, 32, 32, 0, 0, 640, 420)) // check if is on screen
-        {
-            asteroid->exists = false;
+    // already close, it never joins the swarm
+    if (eventAge <= bornAge){
+        placeAsteroid(collection, swarmMemberAsteroid(swarm, member, swarm->originTick));
+        return;
+    }
 
-        }
+    swarm->eventAt[member] = swarm->originTick + eventAge;
+    swarm->eventKind[member] = eventKind;
+    swarm->members |= 1 << member;
+    collection->swarmMembers++;
+    scheduleTimer(&gameTimers, swarm->eventAt[member], TIMER_SWARM_MEMBER, swarmIndex * MAX_SWARM_MEMBERS + member, 0);
+}
 
-        // collisions with rockets
-        if (asteroid->size > 0){
-            for (int j = 0; j < MAX_ROCKETS; j++){
-                Rocket* r = &rockets[j];
+// returns true if the member expired, expired is then set to it as a regular asteroid
+bool fireSwarmTimer(AsteroidCollection* collection, GameState* state, Timer* timer, Asteroid* expired){
+    Swarm* swarm = &collection->swarms[timer->index / MAX_SWARM_MEMBERS];
+    int member = timer->index % MAX_SWARM_MEMBERS;
+    if (((swarm->members >> member) & 1) == 0 || swarm->eventAt[member] != timer->due){
+        return false;
+    }
+    removeSwarmMember(collection, swarm, member);
 
-                if (r->exists && checkBoxCollisions(r->x, r->y, 32, 32, asteroid->x, asteroid->y, 32, 32)){
-                    destroyAsteroid(asteroid, collection, particles);
-                    r->exists = false;
-                    screenShake(2);
-                }
+    // where a regular asteroid would be at the start of this update, before it moves
+    int tick = fmax(swarm->originTick, state->gameTimer - state->tickStep);
+    switch (swarm->eventKind[member]){
+        case SWARM_MATERIALIZE:
+            placeAsteroid(collection, swarmMemberAsteroid(swarm, member, tick));
+            break;
+        case SWARM_EXPIRE:
+            *expired = swarmMemberAsteroid(swarm, member, tick);
+            return true;
+    }
+    return false;
+}
 
+void drawSwarms(AsteroidCollection* collection, GameState* state){
+    if (!isDrawingEnabled()){
+        return;
+    }
+    for (int i = 0; i < collection->capacity; i++){
+        Swarm* swarm = &collection->swarms[i];
+        for (int member = 0; swarm->members >> member; member++){
+            if ((swarm->members >> member) & 1){
+                float x, y;
+                getSwarmMemberPosition(swarm, member, state->gameTimer, &x, &y);
+                SpriteQuad quad = initSpriteQuadSinCos(swarm->directionX[member], swarm->directionY[member]);
+                drawQuad(ASTEROID_SPRITE_START + ASTEROID_SMALL, x, y, &quad);
             }
         }
-
-        // collisions with tiles
-        StationTile* tile = collidesWithStation(station, asteroid->x, asteroid->y, 32, 32);
-        if (tile != 0){
-            screenShake(0.5f);
-            destroyAsteroid(asteroid, collection, particles);
-            damageTile(tile, asteroid->speed * asteroid->size * 10.0f);
-            updateStationPoweredStatus(station);
-        }
     }
 }
 
 //------------------------------------------------------------------------------------
-// HUD
+// collision events
 //------------------------------------------------------------------------------------
-const char* TILE_NAME_LOOKUP[] = {"wall", "pwr", "gun", "forge"};
-#define DISPLAY_COUNTER_SIZE 10
-void drawHud(GameState* state){
+// collisions found while iterating asteroids are only recorded here and resolved in one go
+// after the loop, so the asteroid array is never modified while it is being walked
+#define EVENT_ASTEROID_EXPIRED 0
+#define EVENT_ROCKET_HIT 1
+#define EVENT_TILE_HIT 2
+struct CollisionEvent{
+    int type;
+    Asteroid asteroid; // copy of the asteroid at the time of the collision
+    int tile; // index into the station tiles
+};
+typedef struct CollisionEvent CollisionEvent;
+
+// every asteroid slot produces at most one event per tick, and so does every swarm member, they can
+// expire from fireGameTimers. the queue grows with the asteroid collection to fit all of them
+struct CollisionEventQueue{
+    CollisionEvent* events;
+    int capacity;
+    int count;
+};
+typedef struct CollisionEventQueue CollisionEventQueue;
+CollisionEventQueue collisionEvents = {0};
+
+void reserveCollisionEvents(AsteroidCollection* collection){
+    int capacity = collection->capacity * (1 + MAX_SWARM_MEMBERS);
+    if (collisionEvents.capacity >= capacity){
+        return;
+    }
+    CollisionEvent* grown = fAlloc(EVENT_MEMORY, sizeof(CollisionEvent) * capacity);
+    if (collisionEvents.count > 0){
+        memcpy(grown, collisionEvents.events, sizeof(CollisionEvent) * collisionEvents.count);
+    }
+    fFree(collisionEvents.events);
+    collisionEvents.events = grown;
+    collisionEvents.capacity = capacity;
+}
+
+void disposeCollisionEvents(){
+    fFree(collisionEvents.events);
+    collisionEvents.events = 0;
+    collisionEvents.capacity = 0;
+    collisionEvents.count = 0;
+}
+
+void pushCollisionEvent(int type, Asteroid* asteroid, int tile){
+    assert(collisionEvents.count < collisionEvents.capacity);
+
+    CollisionEvent* e = &collisionEvents.events[collisionEvents.count++];
+    e->type = type;
+    e->asteroid = *asteroid;
+    e->tile = tile;
+
+    // the asteroid is gone from now on, nothing else can collide with it this tick
+    asteroid->exists = false;
+}
+
+void resolveCollisionEvents(AsteroidCollection* collection, GameState* state, Station* station, Particle** particles){
+    float shake = 0.0f;
+    bool stationChanged = false;
+
+    // every event spawns exactly one pow particle
+    reserveParticles(collisionEvents.count);
+    for (int i = 0; i < collisionEvents.count; i++){
+        CollisionEvent* e = &collisionEvents.events[i];
+
+        switch (e->type){
+            case EVENT_ROCKET_HIT:
+                shake += 2.0f;
+                break;
+            case EVENT_TILE_HIT:
+                shake += 0.5f;
+                damageTile(station, e->tile, e->asteroid.speed * e->asteroid.size * 10.0f);
+                if (!tileExists(station, e->tile)){
+                    stationChanged = true;
+                }
+                break;
+        }
+
+        // spawns the pow particle and the children, which get their first update next tick
+        destroyAsteroid(&e->asteroid, collection, state, particles);
+    }
+
+    if (shake > 0.0f){
+        screenShake(shake);
+    }
+
+    // powered status only depends on which tiles exist
+    if (stationChanged){
+        updateStationPoweredStatus(station);
+    }
+
+    collisionEvents.count = 0;
+}
+
+#define ASTEROID_SPAWN_DISTANCE 356
+void updateAsteroids(AsteroidCollection* collection, GameState* state, Station* station, Particle** particles){
+    reserveCollisionEvents(collection);
+    setSwarmZone(collection, station);
+
+    // spawn asteroids
+    if (state->state == STATE_ATTACK){
+
+        for (int spawnRound = countPeriodsCrossed(state, 10); spawnRound > 0 && state->waveTimer > 0; spawnRound--){
+
+            for (int i = GetRandomValue(1, state->difficulity); i > 0;i--){
+
+                float direction = GetRandomValue(0, 360) * DEG2RAD;
+
+
+                float spawnX = collection->targetX + (sin(direction + PI) * ASTEROID_SPAWN_DISTANCE);
+                float spawnY = collection->targetY + (cos(direction + PI) * ASTEROID_SPAWN_DISTANCE);
+
+                float speed = 1.0f + (GetRandomValue(0, 4) * 0.2f);
+                int size = GetRandomValue(ASTEROID_SMALL, ASTEROID_LARGE);
+
+                initAsteroid(collection, state, spawnX, spawnY, size, direction, speed, true);
+            }
+        }
+    }
+    // update asteroids
+    for (int i = 0; i < collection->capacity; i++){
+        Asteroid* asteroid = &collection->asteroids[i];
+
+
+        if (!asteroid->exists){
+            continue;
+        }
+
+        // move
+        float dx = sin(asteroid->direction) * asteroid->speed * state->tickStep;
+        float dy = cos(asteroid->direction) * asteroid->speed * state->tickStep;
+        float startX = asteroid->x;
+        float startY = asteroid->y;
+        asteroid->x += dx;
+        asteroid->y += dy;
+
+        // draw
+        drawQuad(ASTEROID_SPRITE_START + asteroid->size, asteroid->x, asteroid->y, &asteroid->quad);
+
+
+        // running out of lifetime is handled by its timer
+        if (state->gameTimer - asteroid->spawnedAt > ASTEROID_DESPAWN_AGE
+            && !checkBoxCollisions(asteroid->x, asteroid->y, 32, 32, SCREEN_AREA.x, SCREEN_AREA.y, SCREEN_AREA.width, SCREEN_AREA.height)) // check if is on screen
+        {
+            asteroid->exists = false;
+            continue;
+        }
+
+        // collisions with rockets
+        if (asteroid->size > 0){
+            for (int j = 0; j < rocketCapacity; j++){
+                Rocket* r = &rockets[j];
+
+                if (!r->exists){
+                    continue;
+                }
+
+                // rockets have already moved during their last update, which may have had another tick
+                // step, so sweep the asteroid relative to the move the rocket actually made
+                float rdx = r->lastDx;
+                float rdy = r->lastDy;
+                if (checkSweptBoxCollisions(startX, startY, 32, 32, dx - rdx, dy - rdy, r->x - rdx, r->y - rdy, 32, 32)){
+                    pushCollisionEvent(EVENT_ROCKET_HIT, asteroid, -1);
+                    r->exists = false;
+                    break;
+                }
+
+            }
+            if (!asteroid->exists){
+                continue;
+            }
+        }
+
+        // collisions with tiles
+        int tile = sweptCollidesWithStation(station, startX, startY, 32, 32, dx, dy);
+        if (tile >= 0){
+            pushCollisionEvent(EVENT_TILE_HIT, asteroid, tile);
+        }
+    }
+
+    drawSwarms(collection, state);
+    resolveCollisionEvents(collection, state, station, particles);
+}
+
+//------------------------------------------------------------------------------------
+// game update
+//------------------------------------------------------------------------------------
+void disposeGame(Station* station, AsteroidCollection* asteroids, Particle** particles){
+    disposeStation(station);
+    disposeAsteroidCollection(asteroids);
+    disposeRockets();
+    disposeCollisionEvents();
+    disposeTimerWheel(&gameTimers);
+    freeParticles(particles);
+}
+
+void restartGame(GameState* state, Station* station, AsteroidCollection* asteroids, Particle** particles){
+    disposeGame(station, asteroids, particles);
+    logMemoryStats();
+    *state = initGameState();
+    *station = initStation(304, 164, MAX_STATION_TILES);
+    *asteroids = initAsteroidCollection(304, 164, MAX_ASTEROIDS);
+    initRockets(MAX_ROCKETS);
+    initGameTimers();
+}
+
+void recordReplayTick(int tickStep);
+
+// a timer only does anything if what it was set for is still around, slots get reused
+void fireGameTimers(GameState* state, Station* station, AsteroidCollection* asteroids){
+    reserveCollisionEvents(asteroids);
+
+    Timer timer;
+    while (popDueTimer(&gameTimers, state->gameTimer, &timer)){
+        switch (timer.kind){
+            case TIMER_TURRET_READY: {
+                int index = timer.index;
+                if (tileExists(station, index) && station->tiles[index].type == STATION_TURRET && station->tileCold[index].readyAt == timer.due){
+                    listReadyTurret(station, timer.index);
+                }
+                break;
+            }
+            case TIMER_ASTEROID_EXPIRE: {
+                Asteroid* asteroid = &asteroids->asteroids[timer.index];
+                if (asteroid->exists && asteroid->expiresAt == timer.due){
+                    pushCollisionEvent(EVENT_ASTEROID_EXPIRED, asteroid, -1);
+                }
+                break;
+            }
+            case TIMER_ROCKET_EXPIRE: {
+                Rocket* r = &rockets[timer.index];
+                if (r->exists && r->expiresAt == timer.due){
+                    r->exists = false;
+                }
+                break;
+            }
+            case TIMER_PARTICLE_EXPIRE:
+                ((Particle*)timer.data)->destroy = true;
+                break;
+            case TIMER_SWARM_MEMBER: {
+                Asteroid expired;
+                if (fireSwarmTimer(asteroids, state, &timer, &expired)){
+                    pushCollisionEvent(EVENT_ASTEROID_EXPIRED, &expired, -1);
+                }
+                break;
+            }
+        }
+    }
+}
+
+void updateGame(GameState* state, Station* station, AsteroidCollection* asteroids, Particle** particles){
+    fStageBegin("updateStation");
+    updateStation(station, state, particles, asteroids);
+    fStageEnd();
+
+    fStageBegin("updateGameState");
+    updateGameState(state, asteroids);
+    fireGameTimers(state, station, asteroids);
+    fStageEnd();
+
+    fStageBegin("updateAsteroids");
+    updateAsteroids(asteroids, state, station, particles);
+    fStageEnd();
+
+    fStageBegin("updateParticles");
+    updateParticles(particles, state);
+    fStageEnd();
+
+    fStageBegin("updateRockets");
+    updateRockets(particles, state);
+    fStageEnd();
+
+    recordReplayTick(state->tickStep);
+
+    if (state->state == STATE_GAME_OVER && isInputPressed(INPUT_RESTART)){
+        restartGame(state, station, asteroids, particles);
+    }
+}
+
+// nothing on screen would change if the frame was drawn again
+bool isGameIdle(GameState* state, Station* station, Particle* particles){
+    if (state->state != STATE_BUILD || state->giveReward || particles != 0 || isScreenShaking()){
+        return false;
+    }
+
+    for (int i = 0; i < rocketCapacity; i++){
+        if (rockets[i].exists){
+            return false;
+        }
+    }
+
+    // unpowered tiles pulse
+    for (int i = nextTile(station, 0); i >= 0; i = nextTile(station, i + 1)){
+        if (!isTilePowered(station, i)){
+            return false;
+        }
+    }
+    return true;
+}
+
+
+//------------------------------------------------------------------------------------
+// telemetry
+//------------------------------------------------------------------------------------
+int countParticles(Particle* particles){
+    int out = 0;
+    for (Particle* iter = particles; iter != 0; iter = iter->next){
+        out++;
+    }
+    return out;
+}
+
+void recordGameTelemetry(GameState* state, Station* station, AsteroidCollection* asteroids, Particle* particles){
+    if (!isTelemetryRecording()){
+        return;
+    }
+
+    int asteroidCount = asteroids->swarmMembers;
+    for (int i = 0; i < asteroids->capacity; i++){
+        asteroidCount += asteroids->asteroids[i].exists;
+    }
+    int rocketCount = 0;
+    for (int i = 0; i < rocketCapacity; i++){
+        rocketCount += rockets[i].exists;
+    }
+    int tileCount = countSetBits(station->tileExists, station->tileCapacity);
+
+    fCounter("asteroids", asteroidCount);
+    fCounter("rockets", rocketCount);
+    fCounter("particles", countParticles(particles));
+    fCounter("tiles", tileCount);
+    fCounter("state", state->state);
+    fCounter("wave", state->wave);
+}
+
+// F2 starts and stops a recording named after the current time
+void toggleTelemetryRecording(){
+    if (isTelemetryRecording()){
+        stopTelemetry();
+        return;
+    }
+    char path[64];
+    sprintf(path, "telemetry_%li.json", (long)time(0));
+    startTelemetry(path, TELEMETRY_CHROME_TRACE);
+}
+
+//------------------------------------------------------------------------------------
+// turbo
+//------------------------------------------------------------------------------------
+// fast forwards attack waves, only the last update of a frame gets drawn
+#define TURBO_TICK_STEP 4
+#define MAX_TURBO_UPDATES 8
+// share of a 60 fps frame the turbo updates may take, the rest is left for drawing
+#define TURBO_FRAME_BUDGET (0.6f / 60.0f)
+struct Turbo{
+    bool enabled;
+    int updatesPerFrame;
+};
+typedef struct Turbo Turbo;
+Turbo turbo = {false, 1};
+
+bool isTurboActive(GameState* state){
+    return turbo.enabled && state->state == STATE_ATTACK;
+}
+
+void updateTurbo(GameState* state, Station* station, AsteroidCollection* asteroids, Particle** particles){
+    setTickStep(state, TURBO_TICK_STEP);
+
+    double start = fGetTime();
+    setDrawingEnabled(false);
+    for (int i = 1; i < turbo.updatesPerFrame && state->state == STATE_ATTACK; i++){
+        updateGame(state, station, asteroids, particles);
+    }
+    setDrawingEnabled(true);
+    updateGame(state, station, asteroids, particles);
+    double elapsed = fGetTime() - start;
+
+    // adapt to what the cpu can do, backing off quickly and speeding up slowly
+    if (elapsed > TURBO_FRAME_BUDGET){
+        turbo.updatesPerFrame = fmax(1, turbo.updatesPerFrame >> 1);
+    }else if (elapsed < TURBO_FRAME_BUDGET * 0.5f && turbo.updatesPerFrame < MAX_TURBO_UPDATES){
+        turbo.updatesPerFrame++;
+    }
+
+    setTickStep(state, 1);
+}
+
+//------------------------------------------------------------------------------------
+// autopilot
+//------------------------------------------------------------------------------------
+// a build policy stands in for the player: it looks at the world and returns the input for the
+// tick, the same bits the keyboard would set. attacks play out on their own, so a policy only
+// has to act in the build phase and on game over
+typedef GameInput (*BuildPolicy)(GameState* state, Station* station);
+
+struct BuildTarget{
+    int x;
+    int y;
+    int type;
+};
+typedef struct BuildTarget BuildTarget;
+
+bool isCellPowered(Station* station, int x, int y){
+    for (int nx = x - 1; nx <= x + 1; nx++){
+        for (int ny = y - 1; ny <= y + 1; ny++){
+            int neighbour = getTile(station, nx, ny);
+            if (neighbour >= 0 && isTileTypeGenerator(station->tiles[neighbour].type)){
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// the free cells next to the station that are closest to the core, one with power and one without
+void findFreeCells(Station* station, int* poweredX, int* poweredY, int* unpoweredX, int* unpoweredY, bool* powered, bool* unpowered){
+    int poweredDistance = INT_MAX;
+    int unpoweredDistance = INT_MAX;
+    for (int i = nextTile(station, 0); i >= 0; i = nextTile(station, i + 1)){
+        StationTile* tile = &station->tiles[i];
+        for (int x = tile->stationX - 1; x <= tile->stationX + 1; x++){
+            for (int y = tile->stationY - 1; y <= tile->stationY + 1; y++){
+                int distance = x * x + y * y;
+                if ((distance >= poweredDistance && distance >= unpoweredDistance) || getTile(station, x, y) >= 0){
+                    continue;
+                }
+                if (isCellPowered(station, x, y)){
+                    if (distance < poweredDistance){
+                        poweredDistance = distance;
+                        *poweredX = x;
+                        *poweredY = y;
+                    }
+                }else if (distance < unpoweredDistance){
+                    unpoweredDistance = distance;
+                    *unpoweredX = x;
+                    *unpoweredY = y;
+                }
+            }
+        }
+    }
+    *powered = poweredDistance != INT_MAX;
+    *unpowered = unpoweredDistance != INT_MAX;
+}
+
+// grows the station outwards from the core. turrets and forges only work next to a generator, so
+// they go on the closest powered cell, about one forge for every two turrets so the scrap keeps coming.
+// a generator goes down once there is no powered cell left, walls fill in when scrap is short.
+// returns false when there is nothing worth building
+bool pickBuildTarget(Station* station, int scrap, BuildTarget* out){
+    int counts[STATION_CORE + 1] = {0};
+    int tileCount = 0;
+    for (int i = nextTile(station, 0); i >= 0; i = nextTile(station, i + 1)){
+        counts[station->tiles[i].type]++;
+        tileCount++;
+    }
+    if (tileCount >= station->tileCapacity){
+        return false;
+    }
+
+    int poweredX, poweredY, unpoweredX, unpoweredY;
+    bool powered, unpowered;
+    findFreeCells(station, &poweredX, &poweredY, &unpoweredX, &unpoweredY, &powered, &unpowered);
+
+    if (!powered){
+        *out = (BuildTarget){unpoweredX, unpoweredY, STATION_GENERATOR};
+        return unpowered && scrap >= STATION_TILE_COST_LOOKUP[STATION_GENERATOR];
+    }
+    int type = counts[STATION_FORGE] * 2 < counts[STATION_TURRET] ? STATION_FORGE : STATION_TURRET;
+    if (scrap >= STATION_TILE_COST_LOOKUP[type]){
+        *out = (BuildTarget){poweredX, poweredY, type};
+        return true;
+    }
+    if (unpowered && counts[STATION_WALL] * 2 < counts[STATION_TURRET] && scrap >= STATION_TILE_COST_LOOKUP[STATION_WALL]){
+        *out = (BuildTarget){unpoweredX, unpoweredY, STATION_WALL};
+        return true;
+    }
+    return false;
+}
+
+// one cursor step towards x, y, 0 if the cursor can't get any closer
+GameInput stepCursorTowards(Station* station, int x, int y){
+    int dx = (x > station->cursorX) - (x < station->cursorX);
+    int dy = (y > station->cursorY) - (y < station->cursorY);
+    if (dx != 0 && canCursorMoveTo(station, station->cursorX + dx, station->cursorY)){
+        return 1 << (dx > 0 ? INPUT_RIGHT : INPUT_LEFT);
+    }
+    if (dy != 0 && canCursorMoveTo(station, station->cursorX, station->cursorY + dy)){
+        return 1 << (dy > 0 ? INPUT_DOWN : INPUT_UP);
+    }
+    return 0;
+}
+
+// the default bot, one key per tick: walk the cursor to the next target and build it, start the
+// wave when there is nothing left to build and restart on game over
+GameInput heuristicBuildPolicy(GameState* state, Station* station){
+    if (state->state == STATE_GAME_OVER){
+        return 1 << INPUT_RESTART;
+    }
+    // rewards and the game over check happen on the first build tick, wait for them
+    if (state->state != STATE_BUILD || state->giveReward){
+        return 0;
+    }
+
+    BuildTarget target;
+    if (!pickBuildTarget(station, state->scrapCount, &target)){
+        return 1 << INPUT_START_WAVE;
+    }
+    if (station->cursorX == target.x && station->cursorY == target.y){
+        return 1 << (INPUT_BUILD_WALL + target.type);
+    }
+    GameInput step = stepCursorTowards(station, target.x, target.y);
+    return step != 0 ? step : 1 << INPUT_START_WAVE;
+}
+
+// runs the game headless with a policy at the controls for a number of waves, restarting on game over,
+// and reports how fast it ticks as the waves get bigger. a soak test and late game profiling workload
+#define AUTOPILOT_SEED 4242
+#define AUTOPILOT_DEFAULT_WAVES 200
+#define AUTOPILOT_REPORT_INTERVAL 25
+// a policy that never starts a wave gets stopped after this many ticks without one
+#define AUTOPILOT_STUCK_TICKS 100000
+int runAutopilot(int waves, BuildPolicy policy){
+    initFrameworkHeadless();
+    nameMemorySubsystems();
+    SetRandomSeed(AUTOPILOT_SEED);
+
+    GameState state = initGameState();
+    Station station = initStation(304, 164, MAX_STATION_TILES);
+    AsteroidCollection asteroids = initAsteroidCollection(304, 164, MAX_ASTEROIDS);
+    Particle* particles = 0;
+    initRockets(MAX_ROCKETS);
+    initGameTimers();
+
+    int played = 0;
+    int restarts = 0;
+    int lastWave = 0;
+    long ticks = 0;
+    long waveTicks = 0;
+    long reportTicks = 0;
+    double start = fGetTime();
+    double reportStart = start;
+    while (played < waves){
+        gameInput = policy(&state, &station);
+        updateGame(&state, &station, &asteroids, &particles);
+        ticks++;
+        waveTicks++;
+
+        if (state.wave < lastWave){
+            restarts++;
+            lastWave = state.wave;
+        }else if (state.wave > lastWave){
+            played++;
+            lastWave = state.wave;
+            waveTicks = 0;
+            if (played % AUTOPILOT_REPORT_INTERVAL == 0){
+                double now = fGetTime();
+                int asteroidCount = asteroids.swarmMembers;
+                for (int i = 0; i < asteroids.capacity; i++){
+                    asteroidCount += asteroids.asteroids[i].exists;
+                }
+                printf("wave %i (%i this game): %.0f ticks/s, %i tiles, %i asteroids, %i scrap\n",
+                    played, state.wave, (ticks - reportTicks) / fmax(now - reportStart, 0.000001),
+                    countSetBits(station.tileExists, station.tileCapacity), asteroidCount, state.scrapCount);
+                reportTicks = ticks;
+                reportStart = now;
+            }
+        }else if (waveTicks > AUTOPILOT_STUCK_TICKS){
+            printf("no new wave in %i ticks, stopping\n", AUTOPILOT_STUCK_TICKS);
+            break;
+        }
+    }
+    double elapsed = fGetTime() - start;
+
+    printf("played %i waves in %li ticks, %.3f s (%.0f ticks/s), %i restarts\n",
+        played, ticks, elapsed, ticks / fmax(elapsed, 0.000001), restarts);
+
+    disposeGame(&station, &asteroids, &particles);
+    disposeFramework();
+    return 0;
+}
+
+//------------------------------------------------------------------------------------
+// replays
+//------------------------------------------------------------------------------------
+// a replay is the seed followed by run length encoded ticks: input bits, tick step and
+// how many ticks in a row had both, the count as a 7 bit varint. runs are streamed out as
+// soon as the input changes, so only the current run is ever held in memory
+#define REPLAY_MAGIC "GRPL"
+#define REPLAY_VERSION 1
+struct Replay{
+    FILE* file;
+    GameInput runInput;
+    int runStep;
+    unsigned int runLength;
+    long ticks;
+};
+typedef struct Replay Replay;
+Replay replay = {0};
+
+bool isReplayRecording(){
+    return replay.file != 0;
+}
+
+void writeReplayRun(){
+    if (replay.runLength == 0){
+        return;
+    }
+    fputc(replay.runInput & 0xff, replay.file);
+    fputc(replay.runInput >> 8, replay.file);
+    fputc(replay.runStep, replay.file);
+    unsigned int length = replay.runLength;
+    while (length >= 0x80){
+        fputc((length & 0x7f) | 0x80, replay.file);
+        length >>= 7;
+    }
+    fputc(length, replay.file);
+    replay.runLength = 0;
+}
+
+bool startReplayRecording(const char* path, unsigned int seed){
+    replay.file = fopen(path, "wb");
+    if (replay.file == 0){
+        TraceLog(LOG_WARNING, "REPLAY: could not open %s", path);
+        return false;
+    }
+    fwrite(REPLAY_MAGIC, 1, 4, replay.file);
+    fputc(REPLAY_VERSION, replay.file);
+    fwrite(&seed, sizeof(seed), 1, replay.file);
+    replay.runLength = 0;
+    replay.ticks = 0;
+    TraceLog(LOG_INFO, "REPLAY: recording to %s with seed %u", path, seed);
+    return true;
+}
+
+void stopReplayRecording(){
+    if (!isReplayRecording()){
+        return;
+    }
+    writeReplayRun();
+    fclose(replay.file);
+    replay.file = 0;
+    TraceLog(LOG_INFO, "REPLAY: recorded %li ticks", replay.ticks);
+}
+
+void recordReplayTick(int tickStep){
+    if (!isReplayRecording()){
+        return;
+    }
+    if (replay.runLength > 0 && (replay.runInput != gameInput || replay.runStep != tickStep)){
+        writeReplayRun();
+    }
+    replay.runInput = gameInput;
+    replay.runStep = tickStep;
+    replay.runLength++;
+    replay.ticks++;
+}
+
+struct ReplayReader{
+    FILE* file;
+    GameInput input;
+    int step;
+    unsigned int remaining; // ticks left in the current run
+};
+typedef struct ReplayReader ReplayReader;
+
+bool readReplayRun(FILE* file, GameInput* input, int* step, unsigned int* length){
+    int low = fgetc(file);
+    int high = fgetc(file);
+    int stepByte = fgetc(file);
+    if (low == EOF || high == EOF || stepByte == EOF){
+        return false;
+    }
+    *input = low | (high << 8);
+    *step = stepByte;
+
+    *length = 0;
+    for (int shift = 0; ; shift += 7){
+        int b = fgetc(file);
+        if (b == EOF){
+            return false;
+        }
+        *length |= (unsigned int)(b & 0x7f) << shift;
+        if (!(b & 0x80)){
+            break;
+        }
+    }
+    return true;
+}
+
+// checks the header and reads the seed, the reader is then at the first tick
+bool openReplay(const char* path, ReplayReader* reader, unsigned int* seed){
+    FILE* file = fopen(path, "rb");
+    char magic[4];
+    if (file == 0 || fread(magic, 1, 4, file) != 4 || memcmp(magic, REPLAY_MAGIC, 4) != 0
+        || fgetc(file) != REPLAY_VERSION || fread(seed, sizeof(*seed), 1, file) != 1){
+        TraceLog(LOG_WARNING, "REPLAY: %s is not a replay", path);
+        if (file != 0){
+            fclose(file);
+        }
+        return false;
+    }
+    reader->file = file;
+    reader->remaining = 0;
+    return true;
+}
+
+bool nextReplayTick(ReplayReader* reader, GameInput* input, int* step){
+    while (reader->remaining == 0){
+        if (!readReplayRun(reader->file, &reader->input, &reader->step, &reader->remaining)){
+            return false;
+        }
+    }
+    reader->remaining--;
+    *input = reader->input;
+    *step = reader->step;
+    return true;
+}
+
+void closeReplay(ReplayReader* reader){
+    fclose(reader->file);
+    reader->file = 0;
+}
+
+// runs a replay headless as fast as possible, handy as a real world performance workload
+int playReplay(const char* path){
+    initFrameworkHeadless();
+    nameMemorySubsystems();
+
+    ReplayReader reader;
+    unsigned int seed;
+    if (!openReplay(path, &reader, &seed)){
+        return 1;
+    }
+    SetRandomSeed(seed);
+
+    GameState state = initGameState();
+    Station station = initStation(304, 164, MAX_STATION_TILES);
+    AsteroidCollection asteroids = initAsteroidCollection(304, 164, MAX_ASTEROIDS);
+    Particle* particles = 0;
+    initRockets(MAX_ROCKETS);
+    initGameTimers();
+
+    long ticks = 0;
+    GameInput input;
+    int step;
+    double start = fGetTime();
+    while (nextReplayTick(&reader, &input, &step)){
+        gameInput = input;
+        setTickStep(&state, step);
+        updateGame(&state, &station, &asteroids, &particles);
+        ticks++;
+    }
+    double elapsed = fGetTime() - start;
+    closeReplay(&reader);
+
+    printf("replayed %li ticks in %.3f s (%.0f ticks/s), wave %i, scrap %i\n",
+        ticks, elapsed, ticks / fmax(elapsed, 0.000001), state.wave, state.scrapCount);
+
+    disposeGame(&station, &asteroids, &particles);
+    disposeFramework();
+    return 0;
+}
+
+//------------------------------------------------------------------------------------
+// state hashes
+//------------------------------------------------------------------------------------
+// a cheap hash of the whole world per tick, one per subsystem. golden traces store them for a
+// scripted run so a later build can be checked tick by tick against it. entities are hashed
+// one by one and summed, so moving them to other slots or changing the storage order doesn't
+// count as a change, only what is in the world does
+#define HASH_GAME_STATE 0
+#define HASH_STATION 1
+#define HASH_ASTEROIDS 2
+#define HASH_ROCKETS 3
+#define HASH_PARTICLES 4
+#define HASH_SUBSYSTEM_COUNT 5
+const char* HASH_SUBSYSTEM_NAMES[] = {"game state", "station", "asteroids", "rockets", "particles"};
+typedef unsigned long long WorldHash[HASH_SUBSYSTEM_COUNT];
+
+unsigned long long hashInt(unsigned long long h, int v){
+    return fHash(h, &v, sizeof(v));
+}
+
+unsigned long long hashFloat(unsigned long long h, float v){
+    return fHash(h, &v, sizeof(v));
+}
+
+void hashWorld(GameState* state, Station* station, AsteroidCollection* asteroids, Particle* particles, WorldHash out){
+    unsigned long long h = HASH_SEED;
+    h = hashInt(h, state->scrapCount);
+    h = hashInt(h, state->state);
+    h = hashInt(h, state->gameTimer);
+    h = hashInt(h, state->waveTimer);
+    h = hashInt(h, state->giveReward);
+    h = hashInt(h, state->wave);
+    h = hashInt(h, state->difficulity);
+    h = hashInt(h, state->rubberBandDifficulityModifier);
+    out[HASH_GAME_STATE] = h;
+
+    h = hashInt(hashInt(HASH_SEED, station->cursorX), station->cursorY);
+    for (int i = nextTile(station, 0); i >= 0; i = nextTile(station, i + 1)){
+        StationTileCold* cold = &station->tileCold[i];
+        unsigned long long tile = hashInt(HASH_SEED, station->tiles[i].stationX);
+        tile = hashInt(tile, station->tiles[i].stationY);
+        tile = hashInt(tile, station->tiles[i].type);
+        tile = hashInt(tile, station->tileX[i]);
+        tile = hashInt(tile, station->tileY[i]);
+        tile = hashInt(tile, isTilePowered(station, i));
+        tile = hashInt(tile, cold->health);
+        tile = hashInt(tile, cold->maxHealth);
+        tile = hashInt(tile, cold->readyAt);
+        h += tile;
+    }
+    out[HASH_STATION] = h;
+
+    h = hashInt(HASH_SEED, asteroids->swarmMembers);
+    for (int i = 0; i < asteroids->capacity; i++){
+        Asteroid* a = &asteroids->asteroids[i];
+        if (a->exists){
+            unsigned long long asteroid = hashFloat(HASH_SEED, a->x);
+            asteroid = hashFloat(asteroid, a->y);
+            asteroid = hashFloat(asteroid, a->direction);
+            asteroid = hashFloat(asteroid, a->speed);
+            asteroid = hashInt(asteroid, a->size);
+            asteroid = hashInt(asteroid, a->spawnedAt);
+            asteroid = hashInt(asteroid, a->expiresAt);
+            h += asteroid;
+        }
+        Swarm* swarm = &asteroids->swarms[i];
+        for (int member = 0; member < MAX_SWARM_MEMBERS; member++){
+            if ((swarm->members >> member) & 1){
+                unsigned long long m = hashFloat(HASH_SEED, swarm->x);
+                m = hashFloat(m, swarm->y);
+                m = hashFloat(m, swarm->speed);
+                m = hashInt(m, swarm->bornAt);
+                m = hashInt(m, swarm->originTick);
+                m = hashFloat(m, swarm->direction[member]);
+                m = hashInt(m, swarm->eventAt[member]);
+                m = hashInt(m, swarm->eventKind[member]);
+                h += m;
+            }
+        }
+    }
+    out[HASH_ASTEROIDS] = h;
+
+    h = HASH_SEED;
+    for (int i = 0; i < rocketCapacity; i++){
+        Rocket* r = &rockets[i];
+        if (r->exists){
+            unsigned long long rocket = hashFloat(HASH_SEED, r->x);
+            rocket = hashFloat(rocket, r->y);
+            rocket = hashFloat(rocket, r->direction);
+            rocket = hashFloat(rocket, r->speed);
+            rocket = hashInt(rocket, r->expiresAt);
+            h += rocket;
+        }
+    }
+    out[HASH_ROCKETS] = h;
+
+    h = HASH_SEED;
+    for (Particle* p = particles; p != 0; p = p->next){
+        unsigned long long particle = hashInt(HASH_SEED, p->x);
+        particle = hashInt(particle, p->y);
+        particle = hashInt(particle, p->type);
+        particle = hashInt(particle, p->destroy);
+        particle = hashInt(particle, p->expiresAt);
+        h += particle;
+    }
+    out[HASH_PARTICLES] = h;
+}
+
+// without a replay the golden run follows this script: build a few tiles around the core,
+// then start a wave whenever the build menu is up and restart on game over. every other
+// stretch of an attack runs at the turbo tick step so that path gets covered too
+#define GOLDEN_SEED 4242
+#define GOLDEN_TICKS 6000
+#define GOLDEN_BUILD_INTERVAL 4
+const int GOLDEN_BUILD_SCRIPT[] = {
+    INPUT_RIGHT, INPUT_BUILD_GENERATOR, INPUT_RIGHT, INPUT_BUILD_TURRET, INPUT_DOWN, INPUT_BUILD_WALL,
+    INPUT_LEFT, INPUT_BUILD_TURRET, INPUT_LEFT, INPUT_BUILD_FORGE, INPUT_UP, INPUT_UP, INPUT_BUILD_TURRET,
+    INPUT_LEFT, INPUT_BUILD_GENERATOR, INPUT_DOWN, INPUT_BUILD_TURRET
+};
+#define GOLDEN_BUILD_SCRIPT_LENGTH ((long)(sizeof(GOLDEN_BUILD_SCRIPT) / sizeof(GOLDEN_BUILD_SCRIPT[0])))
+
+bool nextGoldenTick(ReplayReader* reader, GameState* state, long tick, GameInput* input, int* step){
+    if (reader->file != 0){
+        return nextReplayTick(reader, input, step);
+    }
+    if (tick >= GOLDEN_TICKS){
+        return false;
+    }
+
+    *input = 0;
+    *step = 1;
+    long scriptTick = tick / GOLDEN_BUILD_INTERVAL;
+    if (scriptTick < GOLDEN_BUILD_SCRIPT_LENGTH){
+        if (tick % GOLDEN_BUILD_INTERVAL == 0){
+            *input = 1 << GOLDEN_BUILD_SCRIPT[scriptTick];
+        }
+    }else if (state->state == STATE_BUILD && !state->giveReward){
+        *input = 1 << INPUT_START_WAVE;
+    }else if (state->state == STATE_GAME_OVER){
+        *input = 1 << INPUT_RESTART;
+    }else if (state->state == STATE_ATTACK && (tick / 500) % 2 == 1){
+        *step = TURBO_TICK_STEP;
+    }
+    return true;
+}
+
+// plays the scripted run, or a replay, and either writes the hash of every tick to the trace or
+// compares against it. returns 0 if the run matched
+int runGoldenTrace(const char* tracePath, const char* replayPath, bool check){
+    initFrameworkHeadless();
+    nameMemorySubsystems();
+
+    ReplayReader reader = {0};
+    unsigned int seed = GOLDEN_SEED;
+    if (replayPath != 0 && !openReplay(replayPath, &reader, &seed)){
+        return 1;
+    }
+    FILE* trace = fopen(tracePath, check ? "r" : "w");
+    if (trace == 0){
+        TraceLog(LOG_WARNING, "GOLDEN: could not open %s", tracePath);
+        if (reader.file != 0){
+            closeReplay(&reader);
+        }
+        return 1;
+    }
+    if (!check){
+        fprintf(trace, "# tick %s, %s, %s, %s, %s\n", HASH_SUBSYSTEM_NAMES[0], HASH_SUBSYSTEM_NAMES[1],
+            HASH_SUBSYSTEM_NAMES[2], HASH_SUBSYSTEM_NAMES[3], HASH_SUBSYSTEM_NAMES[4]);
+    }else {
+        fscanf(trace, "%*[^\n]\n");
+    }
+    SetRandomSeed(seed);
+
+    GameState state = initGameState();
+    Station station = initStation(304, 164, MAX_STATION_TILES);
+    AsteroidCollection asteroids = initAsteroidCollection(304, 164, MAX_ASTEROIDS);
+    Particle* particles = 0;
+    initRockets(MAX_ROCKETS);
+    initGameTimers();
+
+    int result = 0;
+    long tick = 0;
+    GameInput input;
+    int step;
+    while (nextGoldenTick(&reader, &state, tick, &input, &step)){
+        gameInput = input;
+        setTickStep(&state, step);
+        updateGame(&state, &station, &asteroids, &particles);
+
+        WorldHash hash;
+        hashWorld(&state, &station, &asteroids, particles, hash);
+        if (!check){
+            fprintf(trace, "%li %016llx %016llx %016llx %016llx %016llx\n", tick, hash[0], hash[1], hash[2], hash[3], hash[4]);
+            tick++;
+            continue;
+        }
+
+        long goldenTick;
+        WorldHash golden;
+        if (fscanf(trace, "%li %llx %llx %llx %llx %llx", &goldenTick, &golden[0], &golden[1], &golden[2], &golden[3], &golden[4]) != 6){
+            printf("golden trace ends at tick %li, the run goes on\n", tick);
+            result = 1;
+            break;
+        }
+        for (int i = 0; i < HASH_SUBSYSTEM_COUNT; i++){
+            if (hash[i] != golden[i]){
+                printf("diverged at tick %li in %s (%016llx, golden %016llx)\n", tick, HASH_SUBSYSTEM_NAMES[i], hash[i], golden[i]);
+                result = 1;
+            }
+        }
+        if (result != 0){
+            break;
+        }
+        tick++;
+    }
+    if (check && result == 0){
+        long goldenTick;
+        if (fscanf(trace, "%li", &goldenTick) == 1){
+            printf("run ends at tick %li, the golden trace goes on\n", tick);
+            result = 1;
+        }else {
+            printf("matched the golden trace for %li ticks\n", tick);
+        }
+    }else if (!check){
+        printf("wrote %li ticks to %s\n", tick, tracePath);
+    }
+
+    fclose(trace);
+    if (reader.file != 0){
+        closeReplay(&reader);
+    }
+    disposeGame(&station, &asteroids, &particles);
+    disposeFramework();
+    return result;
+}
+
+//------------------------------------------------------------------------------------
+// swarm check
+//------------------------------------------------------------------------------------
+// swarms are only a cheaper way of keeping small asteroids, a small asteroid has to be in the same
+// place on every tick and be gone on the same tick whether it started in a swarm or as a regular
+// asteroid. --check-swarms plays random spawns both ways, as wave spawns and as the children of a
+// destroyed asteroid, at the normal and the turbo tick step, and compares the two
+#define SWARM_CHECK_SEED 99
+#define SWARM_CHECK_SPAWNS 64
+#define SWARM_CHECK_TICKS 500
+// positions are worked out in closed form for swarms and step by step for regular asteroids
+#define SWARM_CHECK_TOLERANCE 0.05f
+
+struct SwarmCheckSpawn{
+    float x;
+    float y;
+    float direction;
+    float speed;
+    bool waveSpawn;
+    int step;
+};
+typedef struct SwarmCheckSpawn SwarmCheckSpawn;
+
+// where the only small asteroid in the world is, false once it is gone
+bool findCheckedAsteroid(AsteroidCollection* asteroids, GameState* state, Vector2* out){
+    for (int i = 0; i < asteroids->capacity; i++){
+        Swarm* swarm = &asteroids->swarms[i];
+        if (swarm->members != 0){
+            getSwarmMemberPosition(swarm, __builtin_ctz(swarm->members), state->gameTimer, &out->x, &out->y);
+            return true;
+        }
+        if (asteroids->asteroids[i].exists){
+            *out = (Vector2){asteroids->asteroids[i].x, asteroids->asteroids[i].y};
+            return true;
+        }
+    }
+    return false;
+}
+
+void spawnCheckedAsteroid(AsteroidCollection* asteroids, GameState* state, SwarmCheckSpawn* spawn, bool asSwarm){
+    if (asSwarm){
+        initAsteroid(asteroids, state, spawn->x, spawn->y, ASTEROID_SMALL, spawn->direction, spawn->speed, spawn->waveSpawn);
+    }else {
+        placeAsteroid(asteroids, makeAsteroid(state, spawn->x, spawn->y, ASTEROID_SMALL, spawn->direction, spawn->speed));
+    }
+}
+
+// plays a spawn in an otherwise empty attack and writes the asteroid's position after every tick to
+// track, returns how many ticks it was around
+int traceCheckedAsteroid(SwarmCheckSpawn* spawn, bool asSwarm, Vector2* track){
+    GameState state = initGameState();
+    state.state = STATE_ATTACK; // the wave timer stays at 0, so nothing else spawns
+    setTickStep(&state, spawn->step);
+    Station station = initStation(304, 164, MAX_STATION_TILES);
+    AsteroidCollection asteroids = initAsteroidCollection(304, 164, MAX_ASTEROIDS);
+    Particle* particles = 0;
+    initRockets(MAX_ROCKETS);
+    initGameTimers();
+
+    // same order as updateGame, wave spawns happen at the start of updateAsteroids and the
+    // children of destroyed asteroids once it is done
+    int ticks = 0;
+    while (ticks < SWARM_CHECK_TICKS){
+        updateGameState(&state, &asteroids);
+        fireGameTimers(&state, &station, &asteroids);
+        if (ticks == 0 && spawn->waveSpawn){
+            setSwarmZone(&asteroids, &station);
+            spawnCheckedAsteroid(&asteroids, &state, spawn, asSwarm);
+        }
+        updateAsteroids(&asteroids, &state, &station, &particles);
+        if (ticks == 0 && !spawn->waveSpawn){
+            spawnCheckedAsteroid(&asteroids, &state, spawn, asSwarm);
+        }
+        updateParticles(&particles, &state);
+        if (!findCheckedAsteroid(&asteroids, &state, &track[ticks])){
+            break;
+        }
+        ticks++;
+    }
+
+    disposeGame(&station, &asteroids, &particles);
+    return ticks;
+}
+
+// returns 0 if every spawn played out the same both ways
+int runSwarmCheck(){
+    initFrameworkHeadless();
+    nameMemorySubsystems();
+    SetRandomSeed(SWARM_CHECK_SEED);
+
+    Vector2 regular[SWARM_CHECK_TICKS];
+    Vector2 swarm[SWARM_CHECK_TICKS];
+    int failures = 0;
+    for (int i = 0; i < SWARM_CHECK_SPAWNS; i++){
+        // half of them head for the station like wave spawns, the rest fly off somewhere
+        float angle = GetRandomValue(0, 3600) * 0.1f * DEG2RAD;
+        SwarmCheckSpawn spawn;
+        spawn.x = 304 + sin(angle + PI) * ASTEROID_SPAWN_DISTANCE;
+        spawn.y = 164 + cos(angle + PI) * ASTEROID_SPAWN_DISTANCE;
+        spawn.direction = i % 2 == 0 ? angle : GetRandomValue(0, 3600) * 0.1f * DEG2RAD;
+        spawn.speed = 1.0f + GetRandomValue(0, 4) * 0.2f;
+        spawn.waveSpawn = (i >> 1) % 2 == 0;
+        spawn.step = (i >> 2) % 2 == 0 ? 1 : TURBO_TICK_STEP;
+
+        int regularTicks = traceCheckedAsteroid(&spawn, false, regular);
+        int swarmTicks = traceCheckedAsteroid(&spawn, true, swarm);
+        const char* kind = spawn.waveSpawn ? "wave spawn" : "child";
+        if (regularTicks != swarmTicks){
+            printf("%s %i (step %i): regular asteroid lasted %i ticks, swarm member %i\n", kind, i, spawn.step, regularTicks, swarmTicks);
+            failures++;
+        }
+        for (int tick = 0; tick < min(regularTicks, swarmTicks); tick++){
+            if (fabsf(regular[tick].x - swarm[tick].x) > SWARM_CHECK_TOLERANCE || fabsf(regular[tick].y - swarm[tick].y) > SWARM_CHECK_TOLERANCE){
+                printf("%s %i (step %i) diverged at tick %i: regular %.3f,%.3f swarm %.3f,%.3f\n", kind, i, spawn.step, tick,
+                    regular[tick].x, regular[tick].y, swarm[tick].x, swarm[tick].y);
+                failures++;
+                break;
+            }
+        }
+    }
+    if (failures == 0){
+        printf("swarm members matched regular asteroids for %i spawns\n", SWARM_CHECK_SPAWNS);
+    }
+
+    disposeFramework();
+    return failures != 0;
+}
+
+//------------------------------------------------------------------------------------
+// scenarios
+//------------------------------------------------------------------------------------
+// synthetic worlds for measuring how the update pipeline scales, run headless with --scenarios
+struct Scenario{
+    int tiles;
+    float turretShare;
+    int asteroids;
+};
+typedef struct Scenario Scenario;
+
+#define SCENARIO_TILE_VARIANTS 3
+#define SCENARIO_ASTEROID_VARIANTS 3
+#define SCENARIO_TURRET_VARIANTS 2
+#define SCENARIO_COUNT (SCENARIO_TILE_VARIANTS * SCENARIO_ASTEROID_VARIANTS * SCENARIO_TURRET_VARIANTS)
+const int SCENARIO_TILE_COUNTS[SCENARIO_TILE_VARIANTS] = {10, 100, 1000};
+const int SCENARIO_ASTEROID_COUNTS[SCENARIO_ASTEROID_VARIANTS] = {300, 3000, 30000};
+const float SCENARIO_TURRET_SHARES[SCENARIO_TURRET_VARIANTS] = {0.1f, 0.4f};
+#define SCENARIO_DEFAULT_TICKS 60
+#define SCENARIO_SEED 1234
+// asteroids that split need room for their children
+#define SCENARIO_ASTEROID_HEADROOM 4
+#define SCENARIO_STAGE_COUNT 4
+const char* SCENARIO_STAGE_NAMES[] = {"station", "asteroids", "rockets", "particles"};
+
+struct ScenarioResult{
+    int ticks;
+    double stageTimes[SCENARIO_STAGE_COUNT];
+    double totalTime;
+    long liveAsteroids;
+};
+typedef struct ScenarioResult ScenarioResult;
+
+// lays tiles out in a square spiral around the core, generators are spread evenly so most turrets get power
+void buildScenarioStation(Station* station, Scenario* scenario){
+    int x = 0;
+    int y = 0;
+    int dx = 1;
+    int dy = 0;
+    int legLength = 1;
+    int legProgress = 0;
+    int turns = 0;
+
+    for (int i = 1; i < scenario->tiles; i++){
+        x += dx;
+        y += dy;
+        if (++legProgress == legLength){
+            legProgress = 0;
+            int temp = dx;
+            dx = -dy;
+            dy = temp;
+            if (++turns % 2 == 0){
+                legLength++;
+            }
+        }
+
+        int type = STATION_WALL;
+        if (i % 5 == 0){
+            type = STATION_GENERATOR;
+        }else if (GetRandomValue(0, 999) < scenario->turretShare * 1000){
+            type = STATION_TURRET;
+        }else if (GetRandomValue(0, 3) == 0){
+            type = STATION_FORGE;
+        }
+        placeTile(station, type, x, y);
+    }
+    updateStationPoweredStatus(station);
+}
+
+// a band of asteroids starting just outside the station, all heading for its center
+void spawnScenarioStorm(AsteroidCollection* collection, GameState* state, Scenario* scenario){
+    float radius = sqrt(scenario->tiles) * 16 + DEFAULT_SPRITE_SIZE;
+    for (int i = 0; i < scenario->asteroids; i++){
+        float direction = GetRandomValue(0, 3600) * 0.1f * DEG2RAD;
+        float distance = radius + GetRandomValue(0, ASTEROID_SPAWN_DISTANCE);
+        float spawnX = collection->targetX + (sin(direction + PI) * distance);
+        float spawnY = collection->targetY + (cos(direction + PI) * distance);
+        float speed = 1.0f + (GetRandomValue(0, 4) * 0.2f);
+        initAsteroid(collection, state, spawnX, spawnY, GetRandomValue(ASTEROID_SMALL, ASTEROID_LARGE), direction, speed, false);
+    }
+}
+
+ScenarioResult runScenario(Scenario* scenario, int ticks){
+    SetRandomSeed(SCENARIO_SEED);
+
+    GameState state = initGameState();
+    state.state = STATE_ATTACK;
+    Station station = initStation(304, 164, scenario->tiles);
+    AsteroidCollection asteroids = initAsteroidCollection(304, 164, scenario->asteroids * SCENARIO_ASTEROID_HEADROOM);
+    Particle* particles = 0;
+    initRockets(fmax(MAX_ROCKETS, scenario->tiles * scenario->turretShare));
+    initGameTimers();
+
+    buildScenarioStation(&station, scenario);
+    setSwarmZone(&asteroids, &station);
+    spawnScenarioStorm(&asteroids, &state, scenario);
+
+    ScenarioResult result = {0};
+    double start = fGetTime();
+    for (int tick = 0; tick < ticks; tick++){
+        double t0 = fGetTime();
+        updateStation(&station, &state, &particles, &asteroids);
+        updateGameState(&state, &asteroids);
+        fireGameTimers(&state, &station, &asteroids);
+        double t1 = fGetTime();
+        updateAsteroids(&asteroids, &state, &station, &particles);
+        double t2 = fGetTime();
+        updateRockets(&particles, &state);
+        double t3 = fGetTime();
+        updateParticles(&particles, &state);
+        double t4 = fGetTime();
+
+        result.stageTimes[0] += t1 - t0;
+        result.stageTimes[1] += t2 - t1;
+        result.stageTimes[2] += t3 - t2;
+        result.stageTimes[3] += t4 - t3;
+        result.liveAsteroids += asteroids.swarmMembers;
+        for (int i = 0; i < asteroids.capacity; i++){
+            result.liveAsteroids += asteroids.asteroids[i].exists;
+        }
+        result.ticks++;
+
+        // the storm has cleared and the game went back to building, nothing left to measure
+        if (state.state != STATE_ATTACK){
+            break;
+        }
+    }
+    result.totalTime = fGetTime() - start;
+
+    disposeGame(&station, &asteroids, &particles);
+    return result;
+}
+
+int runScenarioSuite(int ticks, const char* path){
+    initFrameworkHeadless();
+    nameMemorySubsystems();
+
+    FILE* file = fopen(path, "w");
+    if (file == 0){
+        TraceLog(LOG_WARNING, "SCENARIOS: could not open %s", path);
+        return 1;
+    }
+    fprintf(file, "tiles,turret_share,asteroids,ticks,avg_live_asteroids,ms_per_tick,station_ms,asteroids_ms,rockets_ms,particles_ms\n");
+
+    int scenarioCount = 0;
+    Scenario scenarios[SCENARIO_COUNT];
+    ScenarioResult results[SCENARIO_COUNT];
+    for (int t = 0; t < SCENARIO_TILE_VARIANTS; t++){
+        for (int a = 0; a < SCENARIO_ASTEROID_VARIANTS; a++){
+            for (int s = 0; s < SCENARIO_TURRET_VARIANTS; s++){
+                Scenario scenario = {SCENARIO_TILE_COUNTS[t], SCENARIO_TURRET_SHARES[s], SCENARIO_ASTEROID_COUNTS[a]};
+                ScenarioResult result = runScenario(&scenario, ticks);
+                int ranTicks = max(result.ticks, 1);
+                double msPerTick = result.totalTime * 1000.0 / ranTicks;
+
+                fprintf(file, "%i,%.2f,%i,%i,%li,%.4f", scenario.tiles, scenario.turretShare, scenario.asteroids,
+                    result.ticks, result.liveAsteroids / ranTicks, msPerTick);
+                for (int i = 0; i < SCENARIO_STAGE_COUNT; i++){
+                    fprintf(file, ",%.4f", result.stageTimes[i] * 1000.0 / ranTicks);
+                }
+                fprintf(file, "\n");
+                fflush(file);
+
+                scenarios[scenarioCount] = scenario;
+                results[scenarioCount++] = result;
+            }
+        }
+    }
+    fclose(file);
+
+    // ms per tick on a log scale, one bar per scenario, split by stage
+    printf("%-6s %-7s %-6s %10s\n", "tiles", "turrets", "storm", "ms/tick");
+    for (int i = 0; i < scenarioCount; i++){
+        double msPerTick = results[i].totalTime * 1000.0 / max(results[i].ticks, 1);
+        int width = fmax(0, fmin(60, (log10(msPerTick) + 3) * 12));
+        printf("%-6i %-7.2f %-6i %10.4f ", scenarios[i].tiles, scenarios[i].turretShare, scenarios[i].asteroids, msPerTick);
+        for (int stage = 0; stage < SCENARIO_STAGE_COUNT; stage++){
+            int stageWidth = width * (results[i].stageTimes[stage] / results[i].totalTime) + 0.5;
+            for (int c = 0; c < stageWidth; c++){
+                putchar(SCENARIO_STAGE_NAMES[stage][0]);
+            }
+        }
+        putchar('\n');
+    }
+    printf("bars: log scale (1us - 100ms), s = station, a = asteroids, r = rockets, p = particles\n");
+    printf("results written to %s\n", path);
+
+    disposeFramework();
+    return 0;
+}
+
+//------------------------------------------------------------------------------------
+// HUD
+//------------------------------------------------------------------------------------
+const char* TILE_NAME_LOOKUP[] = {"wall", "pwr", "gun", "forge"};
+#define DISPLAY_COUNTER_SIZE 10
+void drawHud(GameState* state){
 
     char display[DISPLAY_COUNTER_SIZE];
 
-    draw(8, 20, 20);
+    drawOverlay(8, 20, 20);
     sprintf(display, "%06i", state->scrapCount);
     drawFancyText(display, 52, 28, 20, WHITE);
 
@@ -838,7 +2560,7 @@ void drawHud(GameState* state){
 
         for (int i = 0; i < 4; i++){
 
-            draw(1 + i, 246 + i * 48, 10);
+            drawOverlay(1 + i, 246 + i * 48, 10);
             char display[20];
             sprintf(display, "%i : %s", i + 1, TILE_NAME_LOOKUP[i]);
             drawFancyText(display, 246 + i * 48, 42, 1, WHITE);
@@ -848,6 +2570,10 @@ void drawHud(GameState* state){
 
         }
 
+    }else if (isTurboActive(state)){
+        sprintf(display, "x%i", turbo.updatesPerFrame * TURBO_TICK_STEP);
+        drawFancyText("turbo", 20, 76, 20, YELLOW);
+        drawFancyText(display, 82, 76, 20, YELLOW);
     }else if (state->state == STATE_GAME_OVER){
         drawFancyText("GAME OVER", 200, 100, 30, WHITE);
         drawFancyText("Press r", 240, 200, 20, WHITE);
@@ -856,43 +2582,240 @@ void drawHud(GameState* state){
 }
 
 
+//------------------------------------------------------------------------------------
+// frame
+//------------------------------------------------------------------------------------
+// keys for tools rather than the game, they sit above the game input bits and never end up in replays
+#define FRAME_KEY_TURBO (1 << 16)
+#define FRAME_KEY_TELEMETRY (1 << 17)
+#define FRAME_KEY_PROFILER (1 << 18)
+#define GAME_INPUT_MASK 0xffff
+
+struct Session{
+    GameState* state;
+    Station* station;
+    AsteroidCollection* asteroids;
+    Particle** particles;
+    bool showProfiler;
+    BuildPolicy autopilot; // plays instead of the keyboard when set
+};
+typedef struct Session Session;
+
+unsigned int pollFrameKeys(){
+    unsigned int keys = pollGameInput();
+    if (IsKeyPressed(KEY_T)){
+        keys |= FRAME_KEY_TURBO;
+    }
+    if (IsKeyPressed(KEY_F2)){
+        keys |= FRAME_KEY_TELEMETRY;
+    }
+    if (IsKeyPressed(KEY_F3)){
+        keys |= FRAME_KEY_PROFILER;
+    }
+    return keys;
+}
+
+// everything a frame does between fDrawBegin and fDrawEnd, or fSnapshotBegin and fSnapshotEnd
+void runFrame(Session* session, unsigned int keys){
+    if (keys & FRAME_KEY_TURBO){
+        turbo.enabled = !turbo.enabled;
+    }
+    if (keys & FRAME_KEY_TELEMETRY){
+        toggleTelemetryRecording();
+    }
+    if (keys & FRAME_KEY_PROFILER){
+        session->showProfiler = !session->showProfiler;
+    }
+
+    gameInput = keys & GAME_INPUT_MASK;
+    if (session->autopilot != 0){
+        gameInput = session->autopilot(session->state, session->station);
+    }
+    if (isTurboActive(session->state)){
+        updateTurbo(session->state, session->station, session->asteroids, session->particles);
+    }else {
+        updateGame(session->state, session->station, session->asteroids, session->particles);
+    }
+    fStageBegin("drawHud");
+    drawHud(session->state);
+    if (session->showProfiler){
+        drawProfilerOverlay(440, 90);
+    }
+    fStageEnd();
+    recordGameTelemetry(session->state, session->station, session->asteroids, *session->particles);
+}
+
+//------------------------------------------------------------------------------------
+// simulation thread
+//------------------------------------------------------------------------------------
+// with --threaded the game ticks on its own thread at a fixed rate, the main thread only polls
+// input and renders the newest snapshot, so vsync stalls and slow ticks stop delaying each other
+#define SIMULATION_TICK (1.0 / 60.0)
+// falling further behind than this drops the missed ticks instead of rushing to catch up
+#define MAX_SIMULATION_LAG (SIMULATION_TICK * 4)
+atomic_bool simulationRunning = false;
+
+void* runSimulation(void* data){
+    Session* session = data;
+    double nextTick = fGetTime();
+    bool forceFrame = true;
+
+    while (atomic_load(&simulationRunning)){
+        unsigned int keys = fTakeInput();
+
+        // same as the single threaded loop, an idle game publishes nothing and the last snapshot stays up
+        if (forceFrame || keys != 0 || session->showProfiler || session->autopilot != 0 || !isGameIdle(session->state, session->station, *session->particles)){
+            fSnapshotBegin();
+            runFrame(session, keys);
+            fSnapshotEnd();
+            forceFrame = keys != 0;
+        }
+
+        nextTick += SIMULATION_TICK;
+        double wait = nextTick - fGetTime();
+        if (wait > 0){
+            WaitTime(wait);
+        }else if (wait < -MAX_SIMULATION_LAG){
+            nextTick = fGetTime();
+        }
+    }
+    return 0;
+}
+
+// returns false if the thread could not be started, the caller falls back to the single threaded loop
+bool runThreadedSession(Session* session){
+    initSnapshots(SNAPSHOT_MEMORY);
+    atomic_store(&simulationRunning, true);
+    pthread_t thread;
+    if (pthread_create(&thread, 0, runSimulation, session) != 0){
+        TraceLog(LOG_WARNING, "SIMULATION: could not start the simulation thread");
+        atomic_store(&simulationRunning, false);
+        return false;
+    }
+
+    while (!WindowShouldClose()){
+        fPostInput(pollFrameKeys());
+        if (fAcquireSnapshot()){
+            fRenderSnapshot();
+        }else {
+            // nothing new, whatever is on screen stays and input keeps getting polled
+            WaitTime(SIMULATION_TICK / 8);
+            PollInputEvents();
+        }
+    }
+
+    atomic_store(&simulationRunning, false);
+    pthread_join(thread, 0);
+    return true;
+}
+
+
 //------------------------------------------------------------------------------------
 // Program main entry point
 //------------------------------------------------------------------------------------
-int main(void)
+#define SPRITE_BUDGET 2000
+#define IDLE_INPUT_TIMEOUT 1.0
+int main(int argc, char** argv)
 {
+    // --scenarios [ticks] [out.csv] runs the scaling suite without a window
+    if (argc > 1 && strcmp(argv[1], "--scenarios") == 0){
+        char* end = "";
+        long ticks = argc > 2 ? strtol(argv[2], &end, 10) : SCENARIO_DEFAULT_TICKS;
+        if (*end != 0 || ticks < 1 || ticks > INT_MAX){
+            printf("usage: --scenarios [ticks, at least 1] [out.csv]\n");
+            return 1;
+        }
+        return runScenarioSuite(ticks, argc > 3 ? argv[3] : "scenarios.csv");
+    }
+
+    // --golden-record <trace> [replay] writes the per tick state hashes of the scripted run, or of a replay,
+    // --golden-check <trace> [replay] runs it again and reports the first tick and subsystem that differ
+    if (argc > 2 && (strcmp(argv[1], "--golden-record") == 0 || strcmp(argv[1], "--golden-check") == 0)){
+        return runGoldenTrace(argv[2], argc > 3 ? argv[3] : 0, strcmp(argv[1], "--golden-check") == 0);
+    }
+
+    // --check-swarms checks that small asteroids behave the same in swarms as on their own
+    if (argc > 1 && strcmp(argv[1], "--check-swarms") == 0){
+        return runSwarmCheck();
+    }
+
+    // --bench-collisions [boxes] [queries] compares the batch box tests with plain ones
+    if (argc > 1 && strcmp(argv[1], "--bench-collisions") == 0){
+        return runBoxBatchBenchmark(argc > 2 ? atoi(argv[2]) : 1000, argc > 3 ? atoi(argv[3]) : 10000);
+    }
+
+    // --autopilot [waves] lets the bot play that many waves without a window
+    if (argc > 1 && strcmp(argv[1], "--autopilot") == 0){
+        return runAutopilot(argc > 2 ? atoi(argv[2]) : AUTOPILOT_DEFAULT_WAVES, heuristicBuildPolicy);
+    }
+
+    // --replay <file> plays a recorded session back without a window
+    if (argc > 2 && strcmp(argv[1], "--replay") == 0){
+        return playReplay(argv[2]);
+    }
+
     initFramework();
+    setSpriteBudget(SPRITE_BUDGET);
+    nameMemorySubsystems();
+
+    unsigned int seed = time(0);
+    SetRandomSeed(seed);
+
+    // --threaded runs the simulation on its own thread, --bot lets the autopilot play in the window
+    bool threaded = false;
+    BuildPolicy autopilot = 0;
+    for (int i = 1; i < argc; i++){
+        if (strcmp(argv[i], "--threaded") == 0){
+            threaded = true;
+        }else if (strcmp(argv[i], "--bot") == 0){
+            autopilot = heuristicBuildPolicy;
+        }
+    }
+
+    // --trace <file.json> or --csv <file.csv> records telemetry from the first frame,
+    // --record <file> records the session for --replay
+    for (int i = 1; i + 1 < argc; i++){
+        if (strcmp(argv[i], "--trace") == 0){
+            startTelemetry(argv[++i], TELEMETRY_CHROME_TRACE);
+        }else if (strcmp(argv[i], "--csv") == 0){
+            startTelemetry(argv[++i], TELEMETRY_CSV);
+        }else if (strcmp(argv[i], "--record") == 0){
+            startReplayRecording(argv[++i], seed);
+        }
+    }
 
     GameState state = initGameState();
-    Station station = initStation(304, 164);
-    AsteroidCollection asteroids = initAsteroidCollection(304, 164);
+    Station station = initStation(304, 164, MAX_STATION_TILES);
+    AsteroidCollection asteroids = initAsteroidCollection(304, 164, MAX_ASTEROIDS);
     Particle* particles = 0;
-    initRockets();
+    initRockets(MAX_ROCKETS);
+    initGameTimers();
+    Session session = {&state, &station, &asteroids, &particles, false, autopilot};
+
+    // a threaded session runs until the window closes, the loop below is then skipped
+    bool ranThreaded = threaded && runThreadedSession(&session);
+    bool forceFrame = true;
     // Main game loop
-    while (!WindowShouldClose())
+    while (!ranThreaded && !WindowShouldClose())
     {
+        // render on change, while the build menu sits untouched the last frame is kept and input is waited for,
+        // a frame still gets drawn after every wait so a key press is handled right away
+        if (!forceFrame && GetKeyPressed() == 0 && !session.showProfiler && session.autopilot == 0 && isGameIdle(&state, &station, particles)){
+            fWaitForInput(IDLE_INPUT_TIMEOUT);
+            forceFrame = true;
+            continue;
+        }
+        forceFrame = false;
         
         fDrawBegin();
             ClearBackground(BLACK);
-            updateStation(&station, &state, &particles, &asteroids);
-            updateGameState(&state, &asteroids);
-            updateAsteroids(&asteroids, &state, &station, &particles);
-            updateParticles(&particles);
-            updateRockets(&particles, &state);
-            drawHud(&state);
-
-
-            if (state.state == STATE_GAME_OVER && IsKeyPressed(KEY_R)){
-                state = initGameState();
-                station = initStation(304, 164);
-                asteroids = initAsteroidCollection(304, 164);
-                initRockets();
-
-            }
+            runFrame(&session, pollFrameKeys());
         fDrawEnd();
         
     }
 
+    stopReplayRecording();
+    disposeGame(&station, &asteroids, &particles);
 	disposeFramework();
     
 
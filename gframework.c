@@ -2,7 +2,14 @@
 #define G_FRAMEWORK
 
 #include "raylib.h"
+#include "rlgl.h"
 #include <math.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 //------------------------------------------------------
 // Conf
 //------------------------------------------------------
@@ -24,6 +31,93 @@ bool checkBoxCollisions(int x1, int y1, int w1, int h1, int x2, int y2, int w2,
            y1 < y2 + h2;
 }
 
+// entry and exit time (0 - 1) of a box moving by dx, dy through a static box, along one axis
+void sweptAxisOverlap(float p1, int s1, float d, float p2, int s2, float* enter, float* exit){
+	if (d == 0){
+		bool overlaps = p1 + s1 > p2 && p1 < p2 + s2;
+		*enter = overlaps ? -INFINITY : INFINITY;
+		*exit = overlaps ? INFINITY : -INFINITY;
+		return;
+	}
+	float t1 = (p2 - s1 - p1) / d;
+	float t2 = (p2 + s2 - p1) / d;
+	*enter = fmin(t1, t2);
+	*exit = fmax(t1, t2);
+}
+
+// time (0 - 1) of the first contact of box 1 moving by dx, dy with the static box 2, -1 if they never touch
+float sweptBoxContactTime(float x1, float y1, int w1, int h1, float dx, float dy, float x2, float y2, int w2, int h2){
+	float enterX, exitX, enterY, exitY;
+	sweptAxisOverlap(x1, w1, dx, x2, w2, &enterX, &exitX);
+	sweptAxisOverlap(y1, h1, dy, y2, h2, &enterY, &exitY);
+
+	float enter = fmax(fmax(enterX, enterY), 0.0f);
+	float exit = fmin(fmin(exitX, exitY), 1.0f);
+
+	if (enter < exit){
+		return enter;
+	}
+	return -1.0f;
+}
+
+// same as checkBoxCollisions, but it also catches boxes that pass through each other during the move
+bool checkSweptBoxCollisions(float x1, float y1, int w1, int h1, float dx, float dy, float x2, float y2, int w2, int h2){
+	return sweptBoxContactTime(x1, y1, w1, h1, dx, dy, x2, y2, w2, h2) >= 0.0f;
+}
+
+// 64 bit fnv-1a, chain calls by passing the last result in as h
+#define HASH_SEED 14695981039346656037ull
+unsigned long long fHash(unsigned long long h, const void* data, size_t size){
+	const unsigned char* bytes = data;
+	for (size_t i = 0; i < size; i++){
+		h = (h ^ bytes[i]) * 1099511628211ull;
+	}
+	return h;
+}
+
+// bitsets are arrays of 32 bit words
+int bitsetWords(int bits){
+	return (bits + 31) >> 5;
+}
+
+bool testBit(const unsigned int* bits, int i){
+	return (bits[i >> 5] >> (i & 31)) & 1;
+}
+
+void setBit(unsigned int* bits, int i, bool value){
+	if (value){
+		bits[i >> 5] |= 1u << (i & 31);
+	}else {
+		bits[i >> 5] &= ~(1u << (i & 31));
+	}
+}
+
+// index of the first set bit at or after from, -1 if there is none
+int nextSetBit(const unsigned int* bits, int from, int count){
+	if (from >= count){
+		return -1;
+	}
+	int word = from >> 5;
+	unsigned int w = bits[word] & (~0u << (from & 31));
+	int words = bitsetWords(count);
+	while (w == 0){
+		if (++word >= words){
+			return -1;
+		}
+		w = bits[word];
+	}
+	int out = (word << 5) + __builtin_ctz(w);
+	return out < count ? out : -1;
+}
+
+int countSetBits(const unsigned int* bits, int count){
+	int out = 0;
+	for (int i = 0; i < bitsetWords(count); i++){
+		out += __builtin_popcount(bits[i]);
+	}
+	return out;
+}
+
 float lerp(float a, float b, float w){
     return a * (1.0 - w) + (b * w);
 }
@@ -43,6 +137,13 @@ int min(int a, int b){
     return b;
 }
 
+int max(int a, int b){
+    if (a > b){
+        return a;
+    }
+    return b;
+}
+
 float sign(float input){
 	if (input == 0){
 		return 0;
@@ -52,6 +153,564 @@ float sign(float input){
 	return -1;
 }
 
+// monotonic time in seconds, works without a window
+double fGetTime(){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1000000000.0;
+}
+
+//------------------------------------------------------
+// batch collisions
+//------------------------------------------------------
+// tests one box against many boxes of the same size, the corners of those are kept as separate
+// short x and y arrays so 8 (sse2) or 16 (avx2) of them are compared per instruction. the
+// overlap test is rewritten into bounds on the corner (x > lo && x < hi) so the lanes only compare
+// and never add. results are bitsets, one bit per box, so they can be and'ed with an exists bitset
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define BOX_BATCH_X86
+#endif
+
+#define BOX_BATCH_SCALAR 0
+#define BOX_BATCH_SSE2 1
+#define BOX_BATCH_AVX2 2
+const char* BOX_BATCH_PATH_NAMES[] = {"scalar", "sse2", "avx2"};
+
+struct BoxBatchBounds{
+	short loX;
+	short hiX;
+	short loY;
+	short hiY;
+};
+typedef struct BoxBatchBounds BoxBatchBounds;
+
+// bit i is set if box i overlaps, n is at most 32
+typedef unsigned int (*BoxBatchKernel)(BoxBatchBounds b, const short* xs, const short* ys, int n);
+
+short clampShort(int v){
+	return v < -32768 ? -32768 : (v > 32767 ? 32767 : v);
+}
+
+BoxBatchBounds boxBatchBounds(int x, int y, int w, int h, int bw, int bh){
+	BoxBatchBounds out = {clampShort(x - bw), clampShort(x + w), clampShort(y - bh), clampShort(y + h)};
+	return out;
+}
+
+unsigned int boxBatchScalar(BoxBatchBounds b, const short* xs, const short* ys, int n){
+	unsigned int out = 0;
+	for (int i = 0; i < n; i++){
+		out |= (unsigned int)(xs[i] > b.loX && xs[i] < b.hiX && ys[i] > b.loY && ys[i] < b.hiY) << i;
+	}
+	return out;
+}
+
+#ifdef BOX_BATCH_X86
+__attribute__((target("sse2")))
+unsigned int boxBatchSse2(BoxBatchBounds b, const short* xs, const short* ys, int n){
+	__m128i loX = _mm_set1_epi16(b.loX);
+	__m128i hiX = _mm_set1_epi16(b.hiX);
+	__m128i loY = _mm_set1_epi16(b.loY);
+	__m128i hiY = _mm_set1_epi16(b.hiY);
+	unsigned int out = 0;
+	int i = 0;
+	for (; i + 8 <= n; i += 8){
+		__m128i x = _mm_loadu_si128((const __m128i*)(xs + i));
+		__m128i y = _mm_loadu_si128((const __m128i*)(ys + i));
+		__m128i hit = _mm_and_si128(_mm_and_si128(_mm_cmpgt_epi16(x, loX), _mm_cmpgt_epi16(hiX, x)),
+			_mm_and_si128(_mm_cmpgt_epi16(y, loY), _mm_cmpgt_epi16(hiY, y)));
+		// narrow the 16 bit lanes to bytes so movemask gives one bit per box
+		out |= (unsigned int)(_mm_movemask_epi8(_mm_packs_epi16(hit, _mm_setzero_si128())) & 0xff) << i;
+	}
+	return out | (boxBatchScalar(b, xs + i, ys + i, n - i) << (i & 31));
+}
+
+__attribute__((target("avx2")))
+unsigned int boxBatchAvx2(BoxBatchBounds b, const short* xs, const short* ys, int n){
+	__m256i loX = _mm256_set1_epi16(b.loX);
+	__m256i hiX = _mm256_set1_epi16(b.hiX);
+	__m256i loY = _mm256_set1_epi16(b.loY);
+	__m256i hiY = _mm256_set1_epi16(b.hiY);
+	unsigned int out = 0;
+	int i = 0;
+	for (; i + 16 <= n; i += 16){
+		__m256i x = _mm256_loadu_si256((const __m256i*)(xs + i));
+		__m256i y = _mm256_loadu_si256((const __m256i*)(ys + i));
+		__m256i hit = _mm256_and_si256(_mm256_and_si256(_mm256_cmpgt_epi16(x, loX), _mm256_cmpgt_epi16(hiX, x)),
+			_mm256_and_si256(_mm256_cmpgt_epi16(y, loY), _mm256_cmpgt_epi16(hiY, y)));
+		__m128i packed = _mm_packs_epi16(_mm256_castsi256_si128(hit), _mm256_extracti128_si256(hit, 1));
+		out |= (unsigned int)(_mm_movemask_epi8(packed) & 0xffff) << i;
+	}
+	return out | (boxBatchScalar(b, xs + i, ys + i, n - i) << (i & 31));
+}
+#endif
+
+int boxBatchPath = -1; // picked on first use
+BoxBatchKernel boxBatchKernel = boxBatchScalar;
+
+// forces a path, mostly for comparing them. paths the cpu can't run fall back to the next best one
+void setBoxBatchPath(int path){
+	boxBatchPath = BOX_BATCH_SCALAR;
+	boxBatchKernel = boxBatchScalar;
+#ifdef BOX_BATCH_X86
+	if (path >= BOX_BATCH_AVX2 && __builtin_cpu_supports("avx2")){
+		boxBatchPath = BOX_BATCH_AVX2;
+		boxBatchKernel = boxBatchAvx2;
+	}else if (path >= BOX_BATCH_SSE2 && __builtin_cpu_supports("sse2")){
+		boxBatchPath = BOX_BATCH_SSE2;
+		boxBatchKernel = boxBatchSse2;
+	}
+#endif
+}
+
+unsigned int boxBatchWord(BoxBatchBounds b, const short* xs, const short* ys, int n){
+	if (boxBatchPath < 0){
+		setBoxBatchPath(BOX_BATCH_AVX2);
+	}
+	return boxBatchKernel(b, xs, ys, n);
+}
+
+// sets bit i of hits (bitsetWords(count) words) for every box i overlapping x, y, w, h, returns the hit count
+int boxBatchHits(int x, int y, int w, int h, const short* xs, const short* ys, int bw, int bh, int count, unsigned int* hits){
+	BoxBatchBounds b = boxBatchBounds(x, y, w, h, bw, bh);
+	int out = 0;
+	for (int base = 0; base < count; base += 32){
+		hits[base >> 5] = boxBatchWord(b, xs + base, ys + base, min(32, count - base));
+		out += __builtin_popcount(hits[base >> 5]);
+	}
+	return out;
+}
+
+// index of the first overlapping box at or after from, -1 if there is none.
+// with a filter bitset only boxes whose bit is set count
+int nextBoxBatchHit(int x, int y, int w, int h, const short* xs, const short* ys, int bw, int bh, int count, const unsigned int* filter, int from){
+	BoxBatchBounds b = boxBatchBounds(x, y, w, h, bw, bh);
+	for (int base = from & ~31; base < count; base += 32){
+		unsigned int word = filter != 0 ? filter[base >> 5] : ~0u;
+		if (base < from){
+			word &= ~0u << (from & 31);
+		}
+		if (word == 0){
+			continue;
+		}
+		word &= boxBatchWord(b, xs + base, ys + base, min(32, count - base));
+		if (word != 0){
+			return base + __builtin_ctz(word);
+		}
+	}
+	return -1;
+}
+
+int firstBoxBatchHit(int x, int y, int w, int h, const short* xs, const short* ys, int bw, int bh, int count, const unsigned int* filter){
+	return nextBoxBatchHit(x, y, w, h, xs, ys, bw, bh, count, filter, 0);
+}
+
+// every box of a against every box of b, row i of hits (bitsetWords(bCount) words each) holds the hits of a[i]
+void boxBatchCross(const short* ax, const short* ay, int aw, int ah, int aCount,
+	const short* bx, const short* by, int bw, int bh, int bCount, unsigned int* hits){
+	for (int i = 0; i < aCount; i++){
+		boxBatchHits(ax[i], ay[i], aw, ah, bx, by, bw, bh, bCount, hits + i * bitsetWords(bCount));
+	}
+}
+
+// times every available path against plain checkBoxCollisions calls, queries boxes against a field of boxes
+int runBoxBatchBenchmark(int boxes, int queries){
+	short* xs = malloc(sizeof(short) * boxes);
+	short* ys = malloc(sizeof(short) * boxes);
+	short* qx = malloc(sizeof(short) * queries);
+	short* qy = malloc(sizeof(short) * queries);
+	unsigned int* hits = malloc(sizeof(unsigned int) * bitsetWords(boxes));
+	for (int i = 0; i < boxes; i++){
+		xs[i] = GetRandomValue(-1000, 1000);
+		ys[i] = GetRandomValue(-1000, 1000);
+	}
+	for (int i = 0; i < queries; i++){
+		qx[i] = GetRandomValue(-1000, 1000);
+		qy[i] = GetRandomValue(-1000, 1000);
+	}
+
+	double start = fGetTime();
+	long scalarHits = 0;
+	for (int q = 0; q < queries; q++){
+		for (int i = 0; i < boxes; i++){
+			scalarHits += checkBoxCollisions(qx[q], qy[q], 32, 32, xs[i], ys[i], 32, 32);
+		}
+	}
+	double scalarTime = fGetTime() - start;
+	printf("%i boxes, %i queries\n", boxes, queries);
+	printf("%-16s %10.3f ms %8li hits\n", "checkBox", scalarTime * 1000.0, scalarHits);
+
+	int failed = 0;
+	int previousPath = boxBatchPath;
+	for (int path = BOX_BATCH_SCALAR; path <= BOX_BATCH_AVX2; path++){
+		setBoxBatchPath(path);
+		if (boxBatchPath != path){
+			printf("%-16s not supported\n", BOX_BATCH_PATH_NAMES[path]);
+			continue;
+		}
+		start = fGetTime();
+		long batchHits = 0;
+		for (int q = 0; q < queries; q++){
+			batchHits += boxBatchHits(qx[q], qy[q], 32, 32, xs, ys, 32, 32, boxes, hits);
+		}
+		double time = fGetTime() - start;
+		printf("%-16s %10.3f ms %8li hits %6.2fx%s\n", BOX_BATCH_PATH_NAMES[path], time * 1000.0, batchHits,
+			scalarTime / fmax(time, 1e-9), batchHits == scalarHits ? "" : "  MISMATCH");
+		failed |= batchHits != scalarHits;
+	}
+	setBoxBatchPath(previousPath < 0 ? BOX_BATCH_AVX2 : previousPath);
+
+	free(xs);
+	free(ys);
+	free(qx);
+	free(qy);
+	free(hits);
+	return failed;
+}
+
+//------------------------------------------------------
+// telemetry
+//------------------------------------------------------
+// opt-in per frame recording of stage timings and counters, written as a chrome trace
+// (chrome://tracing, perfetto) or as csv rows of frame,kind,name,start_ms,value
+#define TELEMETRY_CHROME_TRACE 0
+#define TELEMETRY_CSV 1
+#define MAX_TELEMETRY_STAGE_DEPTH 8
+#define TELEMETRY_FILE_BUFFER_SIZE (1 << 16)
+struct Telemetry{
+	FILE* file;
+	int format;
+	int frame;
+	double startTime;
+	double frameStart;
+	const char* stageNames[MAX_TELEMETRY_STAGE_DEPTH];
+	double stageStarts[MAX_TELEMETRY_STAGE_DEPTH];
+	int stageDepth;
+	bool firstEvent;
+};
+typedef struct Telemetry Telemetry;
+Telemetry telemetry = {0};
+
+bool isTelemetryRecording(){
+	return telemetry.file != 0;
+}
+
+// microseconds since the recording started
+double telemetryTimestamp(double time){
+	return (time - telemetry.startTime) * 1000000.0;
+}
+
+void writeTelemetryEvent(const char* kind, const char* name, double start, double value){
+	if (telemetry.format == TELEMETRY_CSV){
+		fprintf(telemetry.file, "%i,%s,%s,%.3f,%.3f\n", telemetry.frame, kind, name, telemetryTimestamp(start) / 1000.0, value);
+		return;
+	}
+
+	fprintf(telemetry.file, telemetry.firstEvent ? "\n" : ",\n");
+	telemetry.firstEvent = false;
+	if (kind[0] == 's'){
+		fprintf(telemetry.file, "{\"name\":\"%s\",\"cat\":\"stage\",\"ph\":\"X\",\"ts\":%.1f,\"dur\":%.1f,\"pid\":1,\"tid\":1,\"args\":{\"frame\":%i}}",
+			name, telemetryTimestamp(start), value * 1000.0, telemetry.frame);
+	}else {
+		fprintf(telemetry.file, "{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.1f,\"pid\":1,\"args\":{\"value\":%g}}",
+			name, telemetryTimestamp(start), value);
+	}
+}
+
+bool startTelemetry(const char* path, int format){
+	if (isTelemetryRecording()){
+		return false;
+	}
+	telemetry.file = fopen(path, "w");
+	if (telemetry.file == 0){
+		TraceLog(LOG_WARNING, "TELEMETRY: could not open %s", path);
+		return false;
+	}
+	setvbuf(telemetry.file, 0, _IOFBF, TELEMETRY_FILE_BUFFER_SIZE);
+
+	telemetry.format = format;
+	telemetry.frame = 0;
+	telemetry.startTime = fGetTime();
+	telemetry.frameStart = telemetry.startTime;
+	telemetry.stageDepth = 0;
+	telemetry.firstEvent = true;
+
+	if (format == TELEMETRY_CSV){
+		fprintf(telemetry.file, "frame,kind,name,start_ms,value\n");
+	}else {
+		fprintf(telemetry.file, "{\"traceEvents\":[");
+	}
+	TraceLog(LOG_INFO, "TELEMETRY: recording to %s", path);
+	return true;
+}
+
+void stopTelemetry(){
+	if (!isTelemetryRecording()){
+		return;
+	}
+	if (telemetry.format == TELEMETRY_CHROME_TRACE){
+		fprintf(telemetry.file, "\n]}\n");
+	}
+	fclose(telemetry.file);
+	telemetry.file = 0;
+	TraceLog(LOG_INFO, "TELEMETRY: recorded %i frames", telemetry.frame);
+}
+
+// stages can nest, each one is written out as soon as it ends
+void fStageBegin(const char* name){
+	if (!isTelemetryRecording() || telemetry.stageDepth >= MAX_TELEMETRY_STAGE_DEPTH){
+		return;
+	}
+	telemetry.stageNames[telemetry.stageDepth] = name;
+	telemetry.stageStarts[telemetry.stageDepth] = fGetTime();
+	telemetry.stageDepth++;
+}
+
+void fStageEnd(){
+	if (!isTelemetryRecording() || telemetry.stageDepth <= 0){
+		return;
+	}
+	telemetry.stageDepth--;
+	double start = telemetry.stageStarts[telemetry.stageDepth];
+	writeTelemetryEvent("stage", telemetry.stageNames[telemetry.stageDepth], start, (fGetTime() - start) * 1000.0);
+}
+
+void fCounter(const char* name, double value){
+	if (!isTelemetryRecording()){
+		return;
+	}
+	writeTelemetryEvent("counter", name, telemetry.frameStart, value);
+}
+
+void telemetryFrameBegin(){
+	if (!isTelemetryRecording()){
+		return;
+	}
+	telemetry.frameStart = fGetTime();
+	telemetry.stageDepth = 0;
+	fStageBegin("frame");
+}
+
+void telemetryFrameEnd(){
+	if (!isTelemetryRecording()){
+		return;
+	}
+	// closes "frame" along with anything left open
+	while (telemetry.stageDepth > 0){
+		fStageEnd();
+	}
+	telemetry.frame++;
+}
+
+//------------------------------------------------------
+// memory
+//------------------------------------------------------
+// allocations that go through fAlloc / fFree are counted per subsystem,
+// the game names the subsystems it uses with setMemorySubsystemName
+#define MAX_MEMORY_SUBSYSTEMS 8
+struct MemoryStats{
+	const char* name;
+	long allocations;
+	long frees;
+	long liveBlocks;
+	long liveBytes;
+	long peakBytes;
+};
+typedef struct MemoryStats MemoryStats;
+MemoryStats memoryStats[MAX_MEMORY_SUBSYSTEMS];
+int frameAllocations = 0;
+int lastFrameAllocations = 0;
+
+// sits in front of every block, padded so the block keeps malloc's alignment
+union MemoryHeader{
+	struct {
+		size_t size;
+		int subsystem;
+	} info;
+	max_align_t align;
+};
+typedef union MemoryHeader MemoryHeader;
+
+void setMemorySubsystemName(int subsystem, const char* name){
+	memoryStats[subsystem].name = name;
+}
+
+void* fAlloc(int subsystem, size_t size){
+	MemoryHeader* header = malloc(sizeof(MemoryHeader) + size);
+	if (header == 0){
+		return 0;
+	}
+	header->info.size = size;
+	header->info.subsystem = subsystem;
+
+	MemoryStats* stats = &memoryStats[subsystem];
+	stats->allocations++;
+	stats->liveBlocks++;
+	stats->liveBytes += size;
+	if (stats->liveBytes > stats->peakBytes){
+		stats->peakBytes = stats->liveBytes;
+	}
+	frameAllocations++;
+
+	return header + 1;
+}
+
+void fFree(void* ptr){
+	if (ptr == 0){
+		return;
+	}
+	MemoryHeader* header = (MemoryHeader*)ptr - 1;
+
+	MemoryStats* stats = &memoryStats[header->info.subsystem];
+	stats->frees++;
+	stats->liveBlocks--;
+	stats->liveBytes -= header->info.size;
+
+	free(header);
+}
+
+void logMemoryStats(){
+	for (int i = 0; i < MAX_MEMORY_SUBSYSTEMS; i++){
+		MemoryStats* stats = &memoryStats[i];
+		if (stats->allocations == 0){
+			continue;
+		}
+		TraceLog(LOG_INFO, "MEMORY: %s: %li allocations, %li frees, %li bytes live, %li bytes peak",
+			stats->name, stats->allocations, stats->frees, stats->liveBytes, stats->peakBytes);
+	}
+}
+
+void reportMemoryLeaks(){
+	for (int i = 0; i < MAX_MEMORY_SUBSYSTEMS; i++){
+		MemoryStats* stats = &memoryStats[i];
+		if (stats->liveBlocks != 0){
+			TraceLog(LOG_WARNING, "MEMORY: %s leaked %li bytes in %li blocks", stats->name, stats->liveBytes, stats->liveBlocks);
+		}
+	}
+}
+
+//------------------------------------------------------
+// timers
+//------------------------------------------------------
+// timers sit in buckets by due tick, so advancing only ever looks at timers that are due.
+// a bucket holds every timer whose due tick maps to it modulo TIMER_WHEEL_SIZE, timers a lap
+// or more ahead stay in their bucket until their tick comes around
+#define TIMER_WHEEL_SIZE 256
+#define TIMER_NONE -1
+struct Timer{
+	int due;
+	int kind;
+	int index;
+	void* data;
+	int next;
+};
+typedef struct Timer Timer;
+
+struct TimerWheel{
+	Timer* timers;
+	int capacity;
+	int freeTimer;
+	int buckets[TIMER_WHEEL_SIZE];
+	int firing;
+	int now; // last tick whose bucket was collected
+	int count;
+	int memorySubsystem;
+};
+typedef struct TimerWheel TimerWheel;
+
+void linkFreeTimers(TimerWheel* wheel, int from){
+	for (int i = from; i < wheel->capacity; i++){
+		wheel->timers[i].next = i + 1 < wheel->capacity ? i + 1 : TIMER_NONE;
+	}
+	wheel->freeTimer = from;
+}
+
+TimerWheel initTimerWheel(int capacity, int now, int memorySubsystem){
+	TimerWheel out;
+	out.timers = fAlloc(memorySubsystem, sizeof(Timer) * capacity);
+	out.capacity = capacity;
+	out.firing = TIMER_NONE;
+	out.now = now;
+	out.count = 0;
+	out.memorySubsystem = memorySubsystem;
+	for (int i = 0; i < TIMER_WHEEL_SIZE; i++){
+		out.buckets[i] = TIMER_NONE;
+	}
+	linkFreeTimers(&out, 0);
+	return out;
+}
+
+void disposeTimerWheel(TimerWheel* wheel){
+	fFree(wheel->timers);
+	wheel->timers = 0;
+	wheel->capacity = 0;
+	wheel->count = 0;
+}
+
+// timers due at or before the current tick fire on the next advance
+void scheduleTimer(TimerWheel* wheel, int due, int kind, int index, void* data){
+	if (wheel->freeTimer == TIMER_NONE){
+		Timer* old = wheel->timers;
+		wheel->timers = fAlloc(wheel->memorySubsystem, sizeof(Timer) * wheel->capacity * 2);
+		memcpy(wheel->timers, old, sizeof(Timer) * wheel->capacity);
+		fFree(old);
+		wheel->capacity *= 2;
+		linkFreeTimers(wheel, wheel->capacity / 2);
+	}
+
+	if (due <= wheel->now){
+		due = wheel->now + 1;
+	}
+
+	int i = wheel->freeTimer;
+	Timer* timer = &wheel->timers[i];
+	wheel->freeTimer = timer->next;
+
+	timer->due = due;
+	timer->kind = kind;
+	timer->index = index;
+	timer->data = data;
+	int* bucket = &wheel->buckets[due & (TIMER_WHEEL_SIZE - 1)];
+	timer->next = *bucket;
+	*bucket = i;
+	wheel->count++;
+}
+
+// hands out the timers due up to now one by one, returns false once there are none left
+bool popDueTimer(TimerWheel* wheel, int now, Timer* out){
+	while (wheel->firing == TIMER_NONE && wheel->now < now){
+		wheel->now++;
+		int* bucket = &wheel->buckets[wheel->now & (TIMER_WHEEL_SIZE - 1)];
+		int i = *bucket;
+		*bucket = TIMER_NONE;
+
+		while (i != TIMER_NONE){
+			Timer* timer = &wheel->timers[i];
+			int next = timer->next;
+			if (timer->due == wheel->now){
+				timer->next = wheel->firing;
+				wheel->firing = i;
+			}else {
+				timer->next = *bucket;
+				*bucket = i;
+			}
+			i = next;
+		}
+	}
+
+	if (wheel->firing == TIMER_NONE){
+		return false;
+	}
+
+	int i = wheel->firing;
+	*out = wheel->timers[i];
+	wheel->firing = out->next;
+	wheel->timers[i].next = wheel->freeTimer;
+	wheel->freeTimer = i;
+	wheel->count--;
+	return true;
+}
+
 //------------------------------------------------------
 // sprites
 //------------------------------------------------------
@@ -77,6 +736,29 @@ void unloadSpriteSheet(FrameworkSpriteSheet spriteSheet){
 	UnloadTexture(spriteSheet.spriteSheetTexture);
 }
 
+// corners of a rotated sprite relative to its center, for things that never change direction.
+// worked out once so drawing them is just a translation. sprites are square and rotate around
+// their center, so the bottom corners are the top ones mirrored
+struct SpriteQuad{
+	Vector2 topLeft;
+	Vector2 topRight;
+};
+typedef struct SpriteQuad SpriteQuad;
+
+// for a rotation whose sine and cosine are already known
+SpriteQuad initSpriteQuadSinCos(float sine, float cosine){
+	float half = SPRITE_ORIGIN_OFFSET;
+	SpriteQuad out;
+	out.topLeft = (Vector2){(sine - cosine) * half, -(sine + cosine) * half};
+	out.topRight = (Vector2){(sine + cosine) * half, (sine - cosine) * half};
+	return out;
+}
+
+// rotation in degrees, same as drawR
+SpriteQuad initSpriteQuad(float rotation){
+	return initSpriteQuadSinCos(sinf(rotation * DEG2RAD), cosf(rotation * DEG2RAD));
+}
+
 
 
 
@@ -88,8 +770,17 @@ RenderTexture2D renderTexture;
 Camera2D cam;
 float scalingFactor;
 int renderTextureOffset;
+bool headless = false;
 float screenShakeAmmount = 0.0f;
 int fTimer = 0;
+int spriteBudget = 0; // 0 = unlimited
+// one bit per sprite sized cell of the screen that already has a low priority sprite this frame
+#define MERGE_GRID_COLUMNS 41 // SCREEN_WIDTH / DEFAULT_SPRITE_SIZE, plus one for sprites on the edge
+#define MERGE_GRID_ROWS 24
+unsigned int mergeGrid[(MERGE_GRID_COLUMNS * MERGE_GRID_ROWS + 31) >> 5];
+bool drawingEnabled = true;
+double frameStart = 0;
+double frameTime = 0; // seconds between the last two frame starts
 
 //------------------------------------------------------
 // camera
@@ -98,6 +789,10 @@ void screenShake(float ammount){
 	screenShakeAmmount += ammount;
 }
 
+bool isScreenShaking(){
+	return screenShakeAmmount > 0;
+}
+
 void updateCamera(){
 	screenShakeAmmount = fmin(screenShakeAmmount, 10);
 	Vector2 vec = {sin(fTimer) * screenShakeAmmount, cos(fTimer) * screenShakeAmmount};
@@ -112,11 +807,307 @@ void updateCamera(){
 }
 
 //------------------------------------------------------
-// drawing
+// draw stats
 //------------------------------------------------------
+// what a frame hands to raylib, to tell draw submission and fill rate apart. raylib batches quads
+// into one draw call until the texture changes, and flushes the batch to the gpu when it runs out
+// of draw calls or quads, or when the mode or render target changes. raylib doesn't report flushes,
+// so they are estimated from its default batch limits
+#define RAYLIB_BATCH_DRAW_CALLS 256
+#define RAYLIB_BATCH_QUADS 8192
+#define DRAW_TEXTURE_SPRITES 1
+#define DRAW_TEXTURE_FONT 2
+#define DRAW_TEXTURE_TARGET 3
+struct DrawStats{
+	int sprites;
+	int texts; // DrawText calls
+	int quads;
+	int textureSwitches;
+	int batchFlushes;
+};
+typedef struct DrawStats DrawStats;
+DrawStats drawStats = {0};
+DrawStats lastDrawStats = {0};
+int batchTexture = 0;
+int batchDrawCalls = 0;
+int batchQuads = 0;
 
+// stats of the last finished frame
+DrawStats getDrawStats(){
+	return lastDrawStats;
+}
 
-void drawRC(int spriteIndex, int x, int y, float rotation, Color c){
+void countBatchFlush(){
+	if (batchQuads == 0){
+		return;
+	}
+	drawStats.batchFlushes++;
+	batchTexture = 0;
+	batchDrawCalls = 0;
+	batchQuads = 0;
+}
+
+void countDrawQuads(int texture, int quads){
+	if (batchQuads + quads > RAYLIB_BATCH_QUADS){
+		countBatchFlush();
+	}
+	if (texture != batchTexture){
+		if (batchDrawCalls >= RAYLIB_BATCH_DRAW_CALLS){
+			countBatchFlush();
+		}
+		drawStats.textureSwitches++;
+		batchTexture = texture;
+		batchDrawCalls++;
+	}
+	batchQuads += quads;
+	drawStats.quads += quads;
+}
+
+// one quad per visible character, a fancy text is drawn twice for the shadow
+void countFancyText(const char* text){
+	int quads = 0;
+	for (const char* c = text; *c != 0; c++){
+		quads += *c != ' ' && *c != '\n';
+	}
+	drawStats.texts += 2;
+	countDrawQuads(DRAW_TEXTURE_FONT, quads * 2);
+}
+
+void beginDrawStats(){
+	drawStats = (DrawStats){0};
+	memset(mergeGrid, 0, sizeof(mergeGrid));
+	batchTexture = 0;
+	batchDrawCalls = 0;
+	batchQuads = 0;
+}
+
+// leaving the camera and the render texture flushes, then the render texture is drawn to the screen
+void endDrawStats(){
+	countBatchFlush();
+	countDrawQuads(DRAW_TEXTURE_TARGET, 1);
+	countBatchFlush();
+	lastDrawStats = drawStats;
+	fCounter("sprites", drawStats.sprites);
+	fCounter("texts", drawStats.texts);
+	fCounter("textureSwitches", drawStats.textureSwitches);
+	fCounter("batchFlushes", drawStats.batchFlushes);
+}
+
+//------------------------------------------------------
+// culling
+//------------------------------------------------------
+// rotated sprites can poke out of their 32x32 box, so the view gets a bit of slack
+const int VIEW_CULL_MARGIN = 8;
+// low priority sprites only get this share of the budget, the rest is kept for everything else
+const float LOW_PRIORITY_BUDGET_SHARE = 0.75f;
+
+bool isInView(int x, int y){
+	int viewWidth = SCREEN_WIDTH / cam.zoom;
+	int viewHeight = SCREEN_HEIGHT / cam.zoom;
+	return checkBoxCollisions(x, y, DEFAULT_SPRITE_SIZE, DEFAULT_SPRITE_SIZE,
+		cam.target.x - VIEW_CULL_MARGIN, cam.target.y - VIEW_CULL_MARGIN,
+		viewWidth + (VIEW_CULL_MARGIN << 1), viewHeight + (VIEW_CULL_MARGIN << 1));
+}
+
+// lets the game run updates without putting anything on screen
+void setDrawingEnabled(bool enabled){
+	drawingEnabled = enabled;
+}
+
+bool isDrawingEnabled(){
+	return drawingEnabled;
+}
+
+void setSpriteBudget(int budget){
+	spriteBudget = budget;
+}
+
+bool isSpriteBudgetExhausted(){
+	return spriteBudget > 0 && drawStats.sprites >= spriteBudget;
+}
+
+bool isLowPriorityBudgetExhausted(){
+	return spriteBudget > 0 && drawStats.sprites >= spriteBudget * LOW_PRIORITY_BUDGET_SHARE;
+}
+
+// marks the screen cell under x, y as taken, false if a low priority sprite already took it this frame
+bool claimMergeCell(int x, int y){
+	int column = (x - cam.target.x) * cam.zoom / DEFAULT_SPRITE_SIZE;
+	int row = (y - cam.target.y) * cam.zoom / DEFAULT_SPRITE_SIZE;
+	int cell = min(max(row, 0), MERGE_GRID_ROWS - 1) * MERGE_GRID_COLUMNS + min(max(column, 0), MERGE_GRID_COLUMNS - 1);
+	if (testBit(mergeGrid, cell)){
+		return false;
+	}
+	setBit(mergeGrid, cell, true);
+	return true;
+}
+
+//------------------------------------------------------
+// snapshots
+//------------------------------------------------------
+// lets the simulation run on its own thread. nothing it draws goes to raylib, draw calls are
+// recorded into a snapshot instead and the main thread renders the newest finished one.
+// snapshots rotate through three slots: one being recorded, one being rendered and one holding
+// the newest finished snapshot. handing a slot over is a single atomic exchange, so vsync on one
+// side and a slow tick on the other never hold each other up
+#define DRAW_SPRITE 0
+#define DRAW_TEXT 1
+#define DRAW_QUAD 2
+#define SNAPSHOT_SLOTS 3
+#define SNAPSHOT_FRESH 4 // set on the ready slot until the renderer picks it up
+#define INITIAL_SNAPSHOT_COMMANDS 256
+#define INITIAL_SNAPSHOT_TEXT 1024
+struct DrawCommand{
+	unsigned char kind;
+	short sprite; // text size for DRAW_TEXT
+	short x;
+	short y;
+	Color color;
+	union{
+		struct{
+			float rotation;
+			int text; // offset into the snapshot text
+		};
+		SpriteQuad quad; // DRAW_QUAD only
+	};
+};
+typedef struct DrawCommand DrawCommand;
+
+struct Snapshot{
+	Camera2D camera;
+	DrawCommand* commands;
+	int commandCount;
+	int commandCapacity;
+	char* text;
+	int textLength;
+	int textCapacity;
+};
+typedef struct Snapshot Snapshot;
+
+struct SnapshotBuffer{
+	Snapshot slots[SNAPSHOT_SLOTS];
+	int writing; // only touched by the simulation
+	int reading; // only touched by the renderer
+	atomic_int ready;
+	atomic_uint pendingInput; // input posted by the main thread, taken by the simulation
+	int memorySubsystem;
+};
+typedef struct SnapshotBuffer SnapshotBuffer;
+SnapshotBuffer snapshots = {0};
+Snapshot* recordingSnapshot = 0; // set while the simulation draws into a snapshot
+
+void initSnapshots(int memorySubsystem){
+	snapshots.memorySubsystem = memorySubsystem;
+	for (int i = 0; i < SNAPSHOT_SLOTS; i++){
+		Snapshot* snapshot = &snapshots.slots[i];
+		snapshot->camera = cam;
+		snapshot->commands = fAlloc(memorySubsystem, sizeof(DrawCommand) * INITIAL_SNAPSHOT_COMMANDS);
+		snapshot->commandCount = 0;
+		snapshot->commandCapacity = INITIAL_SNAPSHOT_COMMANDS;
+		snapshot->text = fAlloc(memorySubsystem, INITIAL_SNAPSHOT_TEXT);
+		snapshot->textLength = 0;
+		snapshot->textCapacity = INITIAL_SNAPSHOT_TEXT;
+	}
+	snapshots.writing = 0;
+	snapshots.reading = 1;
+	atomic_store(&snapshots.ready, 2);
+	atomic_store(&snapshots.pendingInput, 0);
+}
+
+void disposeSnapshots(){
+	for (int i = 0; i < SNAPSHOT_SLOTS; i++){
+		fFree(snapshots.slots[i].commands);
+		fFree(snapshots.slots[i].text);
+		snapshots.slots[i].commands = 0;
+		snapshots.slots[i].text = 0;
+	}
+}
+
+DrawCommand* pushDrawCommand(Snapshot* snapshot, int kind, int x, int y, Color c){
+	if (snapshot->commandCount >= snapshot->commandCapacity){
+		DrawCommand* grown = fAlloc(snapshots.memorySubsystem, sizeof(DrawCommand) * snapshot->commandCapacity * 2);
+		memcpy(grown, snapshot->commands, sizeof(DrawCommand) * snapshot->commandCount);
+		fFree(snapshot->commands);
+		snapshot->commands = grown;
+		snapshot->commandCapacity *= 2;
+	}
+	DrawCommand* command = &snapshot->commands[snapshot->commandCount++];
+	command->kind = kind;
+	command->x = x;
+	command->y = y;
+	command->rotation = 0.0f;
+	command->color = c;
+	command->text = 0;
+	return command;
+}
+
+int pushSnapshotText(Snapshot* snapshot, const char* text){
+	int length = strlen(text) + 1;
+	if (snapshot->textLength + length > snapshot->textCapacity){
+		int capacity = snapshot->textCapacity;
+		while (snapshot->textLength + length > capacity){
+			capacity *= 2;
+		}
+		char* grown = fAlloc(snapshots.memorySubsystem, capacity);
+		memcpy(grown, snapshot->text, snapshot->textLength);
+		fFree(snapshot->text);
+		snapshot->text = grown;
+		snapshot->textCapacity = capacity;
+	}
+	int offset = snapshot->textLength;
+	memcpy(snapshot->text + offset, text, length);
+	snapshot->textLength += length;
+	return offset;
+}
+
+// simulation side, wraps a tick the way fDrawBegin and fDrawEnd wrap a frame
+void fSnapshotBegin(){
+	telemetryFrameBegin();
+	updateCamera();
+	fTimer++;
+	beginDrawStats();
+	lastFrameAllocations = frameAllocations;
+	frameAllocations = 0;
+	double now = fGetTime();
+	frameTime = now - frameStart;
+	frameStart = now;
+
+	recordingSnapshot = &snapshots.slots[snapshots.writing];
+	recordingSnapshot->camera = cam;
+	recordingSnapshot->commandCount = 0;
+	recordingSnapshot->textLength = 0;
+}
+
+void fSnapshotEnd(){
+	recordingSnapshot = 0;
+	snapshots.writing = atomic_exchange(&snapshots.ready, snapshots.writing | SNAPSHOT_FRESH) & (SNAPSHOT_FRESH - 1);
+	endDrawStats();
+	fCounter("allocations", frameAllocations);
+	telemetryFrameEnd();
+}
+
+// renderer side, true if a snapshot newer than the last one got picked up
+bool fAcquireSnapshot(){
+	if ((atomic_load(&snapshots.ready) & SNAPSHOT_FRESH) == 0){
+		return false;
+	}
+	snapshots.reading = atomic_exchange(&snapshots.ready, snapshots.reading) & (SNAPSHOT_FRESH - 1);
+	return true;
+}
+
+// input is or'ed together until the simulation takes it, so presses between two ticks are not lost
+void fPostInput(unsigned int input){
+	atomic_fetch_or(&snapshots.pendingInput, input);
+}
+
+unsigned int fTakeInput(){
+	return atomic_exchange(&snapshots.pendingInput, 0);
+}
+
+//------------------------------------------------------
+// drawing
+//------------------------------------------------------
+void blitSprite(int spriteIndex, int x, int y, float rotation, Color c){
 	Rectangle src = {(spriteIndex % loadedSheet.width) * DEFAULT_SPRITE_SIZE, floor((float)spriteIndex / (float)loadedSheet.width) *
 	DEFAULT_SPRITE_SIZE, DEFAULT_SPRITE_SIZE, DEFAULT_SPRITE_SIZE};
 	Rectangle dest = {x + SPRITE_ORIGIN_OFFSET, y + SPRITE_ORIGIN_OFFSET, DEFAULT_SPRITE_SIZE, DEFAULT_SPRITE_SIZE};
@@ -125,13 +1116,82 @@ void drawRC(int spriteIndex, int x, int y, float rotation, Color c){
 
 
 	DrawTexturePro(loadedSheet.spriteSheetTexture, src, dest, origin, rotation, c);
+}
+
+// same quad DrawTexturePro would build, minus the trig
+void blitQuad(int spriteIndex, int x, int y, const SpriteQuad* quad, Color c){
+	Texture2D texture = loadedSheet.spriteSheetTexture;
+	float left = (float)((spriteIndex % loadedSheet.width) * DEFAULT_SPRITE_SIZE) / texture.width;
+	float top = (float)((spriteIndex / loadedSheet.width) * DEFAULT_SPRITE_SIZE) / texture.height;
+	float right = left + (float)DEFAULT_SPRITE_SIZE / texture.width;
+	float bottom = top + (float)DEFAULT_SPRITE_SIZE / texture.height;
+	float centerX = x + SPRITE_ORIGIN_OFFSET;
+	float centerY = y + SPRITE_ORIGIN_OFFSET;
+
+	rlSetTexture(texture.id);
+	rlBegin(RL_QUADS);
+	rlColor4ub(c.r, c.g, c.b, c.a);
+	rlNormal3f(0.0f, 0.0f, 1.0f);
+	rlTexCoord2f(left, top);
+	rlVertex2f(centerX + quad->topLeft.x, centerY + quad->topLeft.y);
+	rlTexCoord2f(left, bottom);
+	rlVertex2f(centerX - quad->topRight.x, centerY - quad->topRight.y);
+	rlTexCoord2f(right, bottom);
+	rlVertex2f(centerX - quad->topLeft.x, centerY - quad->topLeft.y);
+	rlTexCoord2f(right, top);
+	rlVertex2f(centerX + quad->topRight.x, centerY + quad->topRight.y);
+	rlEnd();
+	rlSetTexture(0);
+}
 
+void blitFancyText(const char* text, int x, int y, int scale, Color color){
+	int shadowOffset = fmax(scale / 10.0f, 1);
+	DrawText(text, x + shadowOffset, y, scale, GRAY);
+	DrawText(text, x, y, scale, color);
+}
+
+// counts the sprite and draws or records it, past culling and the budget
+void submitSprite(int spriteIndex, int x, int y, float rotation, Color c){
+	drawStats.sprites++;
+	countDrawQuads(DRAW_TEXTURE_SPRITES, 1);
+
+	if (recordingSnapshot != 0){
+		DrawCommand* command = pushDrawCommand(recordingSnapshot, DRAW_SPRITE, x, y, c);
+		command->sprite = spriteIndex;
+		command->rotation = rotation;
+		return;
+	}
+	blitSprite(spriteIndex, x, y, rotation, c);
+}
+
+void drawRC(int spriteIndex, int x, int y, float rotation, Color c){
+	if (!drawingEnabled || !isInView(x, y) || isSpriteBudgetExhausted()){
+		return;
+	}
+	submitSprite(spriteIndex, x, y, rotation, c);
 }
 
 void drawR(int spriteIndex, int x, int y, float rotation){
 	drawRC(spriteIndex, x, y, rotation, WHITE);
 }
 
+// drawR for a rotation cached with initSpriteQuad
+void drawQuad(int spriteIndex, int x, int y, const SpriteQuad* quad){
+	if (!drawingEnabled || !isInView(x, y) || isSpriteBudgetExhausted()){
+		return;
+	}
+	drawStats.sprites++;
+	countDrawQuads(DRAW_TEXTURE_SPRITES, 1);
+
+	if (recordingSnapshot != 0){
+		DrawCommand* command = pushDrawCommand(recordingSnapshot, DRAW_QUAD, x, y, WHITE);
+		command->sprite = spriteIndex;
+		command->quad = *quad;
+		return;
+	}
+	blitQuad(spriteIndex, x, y, quad, WHITE);
+}
+
 void drawC(int spriteIndex, int x, int y, Color c){
 	drawRC(spriteIndex, x, y, 0.0f, c);
 }
@@ -140,20 +1200,47 @@ void draw(int spriteIndex, int x, int y){
 	drawC(spriteIndex, x, y, WHITE);
 }
 
+// for the HUD and such, still culled but never dropped by the sprite budget
+void drawOverlay(int spriteIndex, int x, int y){
+	if (!drawingEnabled || !isInView(x, y)){
+		return;
+	}
+	submitSprite(spriteIndex, x, y, 0.0f, WHITE);
+}
+
+// for sprites that can go first when a frame gets too busy (particles and such). past their share
+// of the budget they merge, only one per screen cell still gets drawn, so a dense cloud thins out
+// instead of vanishing
+void drawLowPriority(int spriteIndex, int x, int y){
+	if (!drawingEnabled || !isInView(x, y)){
+		return;
+	}
+	bool merged = !claimMergeCell(x, y);
+	if (merged && isLowPriorityBudgetExhausted()){
+		return;
+	}
+	draw(spriteIndex, x, y);
+}
+
 
 
 
 void fDrawBegin(){
+	telemetryFrameBegin();
 	BeginTextureMode(renderTexture);
     BeginMode2D(cam);
 	updateCamera();
 	fTimer++;
+	beginDrawStats();
+	lastFrameAllocations = frameAllocations;
+	frameAllocations = 0;
+	double now = fGetTime();
+	frameTime = now - frameStart;
+	frameStart = now;
 }
 
-void fDrawEnd(){
-	EndMode2D();
-    EndTextureMode();
-    
+// draws the render texture scaled to the window
+void presentRenderTexture(){
     BeginDrawing();
     ClearBackground(BLACK);
     Rectangle r = { 0, 0, (float)(renderTexture.texture.width), (float)(-renderTexture.texture.height) };
@@ -164,11 +1251,106 @@ void fDrawEnd(){
     EndDrawing();
 }
 
+void fDrawEnd(){
+	fStageBegin("present");
+	EndMode2D();
+    EndTextureMode();
+    presentRenderTexture();
+	fStageEnd();
+	endDrawStats();
+	fCounter("allocations", frameAllocations);
+	telemetryFrameEnd();
+}
+
 void drawFancyText(const char* text, int x, int y, int scale, Color color){
-	int shadowOffset = fmax(scale / 10.0f, 1);
-	DrawText(text, x + shadowOffset, y, scale, GRAY);
-	DrawText(text, x, y, scale, color);
+	if (!drawingEnabled){
+		return;
+	}
+	countFancyText(text);
+	if (recordingSnapshot != 0){
+		DrawCommand* command = pushDrawCommand(recordingSnapshot, DRAW_TEXT, x, y, color);
+		command->sprite = scale;
+		command->text = pushSnapshotText(recordingSnapshot, text);
+		return;
+	}
+	blitFancyText(text, x, y, scale, color);
+
+}
+
+// main thread side of a threaded simulation, replays the draw calls of the current snapshot
+void fRenderSnapshot(){
+	Snapshot* snapshot = &snapshots.slots[snapshots.reading];
 
+	BeginTextureMode(renderTexture);
+	BeginMode2D(snapshot->camera);
+	ClearBackground(BLACK);
+	for (int i = 0; i < snapshot->commandCount; i++){
+		DrawCommand* command = &snapshot->commands[i];
+		if (command->kind == DRAW_SPRITE){
+			blitSprite(command->sprite, command->x, command->y, command->rotation, command->color);
+		}else if (command->kind == DRAW_QUAD){
+			blitQuad(command->sprite, command->x, command->y, &command->quad, command->color);
+		}else {
+			blitFancyText(snapshot->text + command->text, command->x, command->y, command->sprite, command->color);
+		}
+	}
+	EndMode2D();
+	EndTextureMode();
+	presentRenderTexture();
+}
+
+//------------------------------------------------------
+// idling
+//------------------------------------------------------
+// how often input gets polled while nothing is being drawn
+const double IDLE_POLL_INTERVAL = 1.0 / 30.0;
+
+// skips drawing and sleeps until a key gets pressed, the window wants to close or the timeout runs out,
+// whatever was presented last stays on screen. returns true if woken up by input
+bool fWaitForInput(double timeout){
+	double end = fGetTime() + timeout;
+	while (fGetTime() < end){
+		WaitTime(IDLE_POLL_INTERVAL);
+		PollInputEvents();
+		if (GetKeyPressed() != 0 || WindowShouldClose()){
+			return true;
+		}
+	}
+	return false;
+}
+
+//------------------------------------------------------
+// profiler overlay
+//------------------------------------------------------
+void drawProfilerOverlay(int x, int y){
+	char line[96];
+
+	sprintf(line, "%i fps  %.2f ms", frameTime > 0 ? (int)(1.0 / frameTime + 0.5) : 0, frameTime * 1000.0);
+	drawFancyText(line, x, y, 10, WHITE);
+	y += 12;
+
+	DrawStats draws = getDrawStats();
+	sprintf(line, "%i sprites  %i texts  %i quads", draws.sprites, draws.texts, draws.quads);
+	drawFancyText(line, x, y, 10, WHITE);
+	y += 12;
+
+	sprintf(line, "%i texture switches  %i batch flushes", draws.textureSwitches, draws.batchFlushes);
+	drawFancyText(line, x, y, 10, WHITE);
+	y += 12;
+
+	sprintf(line, "allocations last frame: %i", lastFrameAllocations);
+	drawFancyText(line, x, y, 10, lastFrameAllocations == 0 ? WHITE : YELLOW);
+	y += 12;
+
+	for (int i = 0; i < MAX_MEMORY_SUBSYSTEMS; i++){
+		MemoryStats* stats = &memoryStats[i];
+		if (stats->name == 0){
+			continue;
+		}
+		sprintf(line, "%s: %li b (%li blocks) peak %li b", stats->name, stats->liveBytes, stats->liveBlocks, stats->peakBytes);
+		drawFancyText(line, x, y, 10, WHITE);
+		y += 12;
+	}
 }
 
 //------------------------------------------------------
@@ -185,10 +1367,24 @@ void initFramework(){
 	cam.zoom = DEFAULT_CAMERA_ZOOM;
 }
 
+// for tools that only run the simulation, no window gets opened and nothing is drawn
+void initFrameworkHeadless(){
+	headless = true;
+	drawingEnabled = false;
+	cam.zoom = DEFAULT_CAMERA_ZOOM;
+}
+
 //------------------------------------------------------
 // dispose
 //------------------------------------------------------
 void disposeFramework(){
+	disposeSnapshots();
+	stopTelemetry();
+	logMemoryStats();
+	reportMemoryLeaks();
+	if (headless){
+		return;
+	}
 	unloadSpriteSheet(loadedSheet);
 	UnloadRenderTexture(renderTexture);
 	CloseWindow();